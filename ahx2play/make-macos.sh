@@ -8,10 +8,13 @@ else
     
     rm release/other/ahx2play &> /dev/null
     
-    clang -mmacosx-version-min=10.7 -arch x86_64 -mmmx -mfpmath=sse -msse2 -I/Library/Frameworks/SDL2.framework/Headers -F/Library/Frameworks -g0 -DNDEBUG -DAUDIODRIVER_SDL ../audiodrivers/sdl/*.c ../*.c src/*.c -O3 -lm -Winit-self -Wno-deprecated -Wextra -Wunused -mno-ms-bitfields -Wno-missing-field-initializers -Wswitch-default -framework SDL2 -framework Cocoa -lm -o release/other/ahx2play
+    # 8bb: generate the waveform tables once, they get compiled into the binary
+    clang -O2 ../tools/wavegen.c ../waves.c -o wavegen && ./wavegen ahxwaves.c
+    
+    clang -mmacosx-version-min=10.7 -arch x86_64 -mmmx -mfpmath=sse -msse2 -I/Library/Frameworks/SDL2.framework/Headers -F/Library/Frameworks -g0 -DNDEBUG -DAUDIODRIVER_SDL -DAHX_CONST_WAVES -I.. ../audiodrivers/sdl/*.c ../*.c src/*.c ahxwaves.c -O3 -lm -Winit-self -Wno-deprecated -Wextra -Wunused -mno-ms-bitfields -Wno-missing-field-initializers -Wswitch-default -framework SDL2 -framework Cocoa -lm -o release/other/ahx2play
     strip release/other/ahx2play
     install_name_tool -change @rpath/SDL2.framework/Versions/A/SDL2 @executable_path/../Frameworks/SDL2.framework/Versions/A/SDL2 release/other/ahx2play
     
-    rm ../*.o src/*.o &> /dev/null
+    rm ../*.o src/*.o wavegen ahxwaves.c &> /dev/null
     echo Done. The executable can be found in \'release/other\' if everything went well.
 fi
@@ -16,22 +16,28 @@
 #define DEFAULT_AUDIO_BUFSIZE 1024
 #define DEFAULT_MASTER_VOL 256
 #define DEFAULT_STEREO_SEPARATION 20
+#define DEFAULT_OUTPUT_CHANNELS 2
 #define DEFAULT_WAVRENDER_LOOPS 0
+#define DEFAULT_WAVRENDER_BITS 16
 
 // set to true if you want ahx2play to always render to WAV
 #define DEFAULT_WAVRENDER_MODE_FLAG false
 
 // default settings
-static bool renderToWavFlag = DEFAULT_WAVRENDER_MODE_FLAG;
+static bool renderToWavFlag = DEFAULT_WAVRENDER_MODE_FLAG, renderStemsFlag = false;
 static int32_t stereoSeparation = DEFAULT_STEREO_SEPARATION;
+static int32_t outputChannels = DEFAULT_OUTPUT_CHANNELS;
+static int32_t voiceMask = 15; // 8bb: all voices
 static int32_t masterVolume = DEFAULT_MASTER_VOL;
 static int32_t audioFrequency = DEFAULT_AUDIO_FREQ;
 static int32_t audioBufferSize = DEFAULT_AUDIO_BUFSIZE;
 static int32_t WAVSongLoopTimes = DEFAULT_WAVRENDER_LOOPS;
+static int32_t WAVBits = DEFAULT_WAVRENDER_BITS;
 // ----------------------------------------------------------
 
 static volatile bool programRunning;
-static char *filename, *WAVRenderFilename;
+static char *filename, *WAVRenderFilename, *WAVStemFilenames[PAULA_VOICES];
+static ahxPlayer_t *player;
 static int32_t oldStereoSeparation;
 
 static void showUsage(void);
@@ -47,7 +53,8 @@ static void *wavRecordingThread(void *arg)
 #endif
 {
 	// 8bb: put this in a thread so that it can be cancelled at any time by pressing a key (it can get stuck in a loop)
-	ahxRecordWAV(filename, WAVRenderFilename, 0, WAVSongLoopTimes, audioFrequency, masterVolume, stereoSeparation);
+	ahxRecordStemsWAV(player, filename, WAVRenderFilename, renderStemsFlag ? (const char *const *)WAVStemFilenames : NULL,
+		0, WAVSongLoopTimes, audioFrequency, masterVolume, stereoSeparation);
 
 #ifdef _WIN32
 	return 0;
@@ -85,16 +92,31 @@ int main(int argc, char *argv[])
 	handleArguments(argc, argv);
 #endif
 
+	// Create AHX player instance
+	player = ahxCreatePlayer();
+	if (player == NULL)
+	{
+		printf("Error: Out of memory!\n");
+		return 1;
+	}
+
+	ahxSetOutputChannels(player, outputChannels); // 8bb: for both playback and WAV rendering
+	ahxSetVoiceMask(player, voiceMask);
+
 	if (renderToWavFlag)
-		return renderToWav();
+	{
+		const int32_t result = renderToWav();
+		ahxDestroyPlayer(player);
+		return result;
+	}
 
 	// Initialize AHX system
-	if (!ahxInit(audioFrequency, audioBufferSize, masterVolume, stereoSeparation))
+	if (!ahxInit(player, audioFrequency, audioBufferSize, masterVolume, stereoSeparation))
 	{
-		ahxClose();
+		ahxClose(player);
 
 		printf("Error initializing AHX replayer: ");
-		switch (ahxGetErrorCode())
+		switch (ahxGetErrorCode(player))
 		{
 			default: printf("Unknown error...\n"); break;
 
@@ -107,16 +129,20 @@ int main(int argc, char *argv[])
 			break;
 		}
 
+		ahxDestroyPlayer(player);
 		return 1;
 	}
 
+	// 8bb: rather drop to a cheaper synthesis quality than have audio dropouts on a slow/busy machine
+	paulaSetAdaptiveQuality(&player->paula, true);
+
 	// Load song
-	if (!ahxLoad(filename))
+	if (!ahxLoad(player, filename))
 	{
-		ahxClose();
+		ahxClose(player);
 
 		printf("Error loading AHX module: ");
-		switch (ahxGetErrorCode())
+		switch (ahxGetErrorCode(player))
 		{
 			default: printf("Unknown error...\n"); break;
 
@@ -137,17 +163,18 @@ int main(int argc, char *argv[])
 			break;
 		}
 
+		ahxDestroyPlayer(player);
 		return 1;
 	}
 
 	// Play song (start at song #0)
-	if (!ahxPlay(0))
+	if (!ahxPlay(player, 0))
 	{
-		ahxFree();
-		ahxClose();
+		ahxFree(player);
+		ahxClose(player);
 
 		printf("Error playing AHX module: ");
-		switch (ahxGetErrorCode())
+		switch (ahxGetErrorCode(player))
 		{
 			default: printf("Unknown error...\n"); break;
 
@@ -159,6 +186,9 @@ int main(int argc, char *argv[])
 				printf("Waveforms are not initialized! Did you call ahxInit()?\n");
 			break;
 
+			case ERR_CMD_QUEUE_FULL:
+				printf("Command queue is full! Is the audio device running?\n");
+			break;
 		}
 	}
 
@@ -179,19 +209,25 @@ int main(int argc, char *argv[])
 	printf("      n = Next sub-song (if any)\n");
 	printf("      p = Previous sub-song (if any)\n");
 	printf("      h = Toggle Amiga hard-panning\n");
+	printf("    1-4 = Toggle voice 1-4 on/off\n");
+
+	const audio_t *audio = &player->paula.audio;
+	const ahxModule_t *module = player->module;
+	const song_t *song = &player->song;
+
 	printf("\n");
-	printf("Master volume: %d (%d%%)\n", audio.masterVol, (int32_t)((audio.masterVol / 256.0) * 100));
-	printf("Audio output frequency: %dHz\n", audio.outputFreq);
-	printf("Initial stereo separation: %d%%\n", audio.stereoSeparation);
+	printf("Master volume: %d (%d%%)\n", audio->masterVol, (int32_t)((audio->masterVol / 256.0) * 100));
+	printf("Audio output frequency: %dHz\n", audio->outputFreq);
+	printf("Initial stereo separation: %d%%\n", audio->stereoSeparation);
 	printf("\n");
 	printf("- SONG INFO -\n");
-	printf(" Name: %s\n", song.Name);
-	printf(" Song revision: v%d\n", song.Revision);
-	printf(" Sub-songs: %d\n", song.Subsongs);
-	printf(" Song length: %d (restart pos: %d)\n", song.LenNr, song.ResNr);
-	printf(" Song tick rate: %.4fHz (%.2f BPM)\n", song.dBPM / 2.5, song.dBPM);
-	printf(" Track length: %d\n", song.TrackLength);
-	printf(" Instruments: %d\n", song.numInstruments);
+	printf(" Name: %s\n", module->Name);
+	printf(" Song revision: v%d\n", module->Revision);
+	printf(" Sub-songs: %d\n", module->Subsongs);
+	printf(" Song length: %d (restart pos: %d)\n", module->LenNr, module->ResNr);
+	printf(" Song tick rate: %.4fHz (%.2f BPM)\n", song->dBPM / 2.5, song->dBPM);
+	printf(" Track length: %d\n", module->TrackLength);
+	printf(" Instruments: %d\n", module->numInstruments);
 	printf("\n");
 	printf("- STATUS -\n");
 
@@ -200,7 +236,7 @@ int main(int argc, char *argv[])
 #endif
 	hideTextCursor();
 
-	oldStereoSeparation = audio.stereoSeparation; // for toggling separation with 'h' key
+	oldStereoSeparation = player->paula.audio.stereoSeparation; // for toggling separation with 'h' key
 
 	programRunning = true;
 	while (programRunning)
@@ -208,8 +244,8 @@ int main(int argc, char *argv[])
 		readKeyboard();
 
 		printf(" Pos: %03d/%03d - Row: %02d/%02d - Speed: %d %s               \r",
-			song.PosNr, song.LenNr, song.NoteNr, song.TrackLength, song.Tempo,
-			audio.pause ? "(PAUSED)" : "");
+			song->PosNr, module->LenNr, song->NoteNr, module->TrackLength, song->Tempo,
+			audio->pause ? "(PAUSED)" : "");
 
 		fflush(stdout);
 		Sleep(50);
@@ -221,11 +257,19 @@ int main(int argc, char *argv[])
 #endif
 	showTextCursor();
 
+	const adaptiveQuality_t *adapt = &player->paula.adapt;
+	if (adapt->stepDowns > 0)
+	{
+		printf("Audio callback overruns: %u, quality step-downs: %u (step-ups: %u)\n",
+			adapt->overruns, adapt->stepDowns, adapt->stepUps);
+	}
+
 	// Free loaded song
-	ahxFree();
+	ahxFree(player);
 
 	// Close AHX system
-	ahxClose();
+	ahxClose(player);
+	ahxDestroyPlayer(player);
 
 	printf("Playback stopped.\n");
 	return 0;
@@ -234,8 +278,9 @@ int main(int argc, char *argv[])
 static void showUsage(void)
 {
 	printf("Usage:\n");
-	printf("  ahx2play input_module [-f hz] [-m mixingvol] [-b buffersize]\n");
-	printf("  ahx2play input_module [-s percentage] [--render-to-wav] [-wloop loops]\n");
+	printf("  ahx2play input_module [-f hz] [-m mixingvol] [-b buffersize] [-c channels]\n");
+	printf("  ahx2play input_module [-s percentage] [--render-to-wav] [-wloop loops] [-wbits bits] [-stems]\n");
+	printf("  ahx2play input_module [-voices list]\n");
 	printf("\n");
 	printf("  Options:\n");
 	printf("    input_module     Specifies the module file to load (.AHX/.THX)\n");
@@ -244,20 +289,29 @@ static void showUsage(void)
 	printf("    -b buffersize    Specifies the audio buffer size (256..8192)\n");
 	printf("    -s percentage    Specifies the stereo separation (0..100).\n");
 	printf("                     0 = mono, 100 = Amiga hard-panning.\n");
+	printf("    -c channels      Specifies the output channels. 1 = mono, 2 = stereo,\n");
+	printf("                     4 = one channel per Paula voice (not mixed).\n");
 	printf("    --render-to-wav  Renders song to WAV instead of playing it. The output\n");
 	printf("                     filename will be the input filename with .WAV added to the\n");
 	printf("                     end.\n");
 	printf("    --wloop loops    Specifies how many times to loop the song during WAV write.\n");
 	printf("                     Parameter 0 = no loop, 1 = loop 1 time, etc.\n");
 	printf("                     Any F00 command will stop the song regardless of setting.\n");
+	printf("    -wbits bits      Specifies the WAV sample format. 16 = 16-bit (dithered),\n");
+	printf("                     24 = 24-bit, 32 = 32-bit float.\n");
+	printf("    -stems           Also renders every voice to its own mono WAV file during WAV\n");
+	printf("                     write (input filename with .1.WAV to .4.WAV added to the end).\n");
+	printf("    -voices list     Only plays/renders these voices, f.ex. 124 = all but voice 3.\n");
 	printf("\n");
 	printf("Default settings (can only be changed in the source code):\n");
 	printf("  - Audio frequency:          %dHz\n", DEFAULT_AUDIO_FREQ);
 	printf("  - Audio buffer size:        %d\n", DEFAULT_AUDIO_BUFSIZE);
 	printf("  - Master volume:            %d\n", DEFAULT_MASTER_VOL);
 	printf("  - Stereo separation:        %d%%\n", DEFAULT_STEREO_SEPARATION);
+	printf("  - Output channels:          %d\n", DEFAULT_OUTPUT_CHANNELS);
 	printf("  - WAV render mode:          %s\n", DEFAULT_WAVRENDER_MODE_FLAG ? "On" : "Off");
 	printf("  - WAV song loop times:      %d\n", DEFAULT_WAVRENDER_LOOPS);
+	printf("  - WAV bits:                 %d\n", DEFAULT_WAVRENDER_BITS);
 	printf("\n");
 }
 
@@ -288,6 +342,11 @@ static void handleArguments(int argc, char *argv[])
 				const int32_t num = atoi(argv[i+1]);
 				stereoSeparation = CLAMP(num, 0, 100);
 			}
+			else if (!_stricmp(argv[i], "-c") && i+1 < argc)
+			{
+				const int32_t num = atoi(argv[i+1]);
+				outputChannels = (num == 1 || num == 4) ? num : 2;
+			}
 			else if (!_stricmp(argv[i], "--render-to-wav"))
 			{
 				renderToWavFlag = true;
@@ -297,12 +356,33 @@ static void handleArguments(int argc, char *argv[])
 				const int32_t num = atoi(argv[i + 1]);
 				WAVSongLoopTimes = CLAMP(num, 0, 100);
 			}
+			else if (!_stricmp(argv[i], "-wbits") && i + 1 < argc)
+			{
+				WAVBits = atoi(argv[i + 1]);
+			}
+			else if (!_stricmp(argv[i], "-stems"))
+			{
+				renderStemsFlag = true;
+			}
+			else if (!_stricmp(argv[i], "-voices") && i+1 < argc)
+			{
+				voiceMask = 0;
+				for (const char *c = argv[i+1]; *c != '\0'; c++)
+				{
+					if (*c >= '1' && *c <= '0'+PAULA_VOICES)
+						voiceMask |= 1 << (*c - '1');
+				}
+			}
 		}
 	}
 }
 
 static void readKeyboard(void)
 {
+	const audio_t *audio = &player->paula.audio;
+	const ahxModule_t *module = player->module;
+	const song_t *song = &player->song;
+
 	if (_kbhit())
 	{
 		const int32_t key = _getch();
@@ -313,48 +393,55 @@ static void readKeyboard(void)
 			break;
 
 			case 'r': // restart
-				ahxPlay(0);
+				ahxPlay(player, 0);
 			break;
 
 			case 'n': // next sub-song
 			{
-				if (song.Subsongs > 0)
+				if (module->Subsongs > 0)
 				{
-					if (song.Subsong < song.Subsongs)
-						ahxPlay(song.Subsong + 1);
+					if (song->Subsong < module->Subsongs)
+						ahxPlay(player, song->Subsong + 1);
 				}
 			}
 			break;
 
 			case 'p': // previous sub-song
 			{
-				if (song.Subsongs > 0)
+				if (module->Subsongs > 0)
 				{
-					if (song.Subsong > 0)
-						ahxPlay(song.Subsong - 1);
+					if (song->Subsong > 0)
+						ahxPlay(player, song->Subsong - 1);
 				}
 			}
 			break;
 
+			case '1': // toggle voice 1..4
+			case '2':
+			case '3':
+			case '4':
+				ahxSetVoiceMask(player, ~player->disabledVoices ^ (1 << (key - '1')));
+			break;
+
 			case 'h': // toggle Amiga hard-pan
 			{
-				if (audio.stereoSeparation == 100)
-					paulaSetStereoSeparation(oldStereoSeparation);
+				if (audio->stereoSeparation == 100)
+					paulaSetStereoSeparation(&player->paula, oldStereoSeparation);
 				else
-					paulaSetStereoSeparation(100);
+					paulaSetStereoSeparation(&player->paula, 100);
 			}
 			break;
 
 			case 0x20: // space (toggle pause)
-				paulaTogglePause();
+				paulaTogglePause(&player->paula);
 			break;
 
 			case 0x2B: // numpad + (next song position)
-				ahxNextPattern();
+				ahxNextPattern(player);
 			break;
 
 			case 0x2D: // numpad - (previous song position)
-				ahxPrevPattern();
+				ahxPrevPattern(player);
 			break;
 			
 			default: break;
@@ -362,6 +449,18 @@ static void readKeyboard(void)
 	}
 }
 
+static void freeWAVFilenames(void)
+{
+	free(WAVRenderFilename);
+	WAVRenderFilename = NULL;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		free(WAVStemFilenames[i]);
+		WAVStemFilenames[i] = NULL;
+	}
+}
+
 static int32_t renderToWav(void)
 {
 	const size_t filenameLen = strlen(filename);
@@ -376,11 +475,32 @@ static int32_t renderToWav(void)
 	strcpy(WAVRenderFilename, filename);
 	strcat(WAVRenderFilename, ".wav");
 
-	isRecordingToWAV = true; // this is also set in wavRecordingThread(), but do it here to be sure...
+	if (renderStemsFlag)
+	{
+		for (int32_t i = 0; i < PAULA_VOICES; i++)
+		{
+			WAVStemFilenames[i] = (char *)malloc(filenameLen+1+1+1+3+1);
+			if (WAVStemFilenames[i] == NULL)
+			{
+				printf("Error: Out of memory!\n");
+				freeWAVFilenames();
+				return 1;
+			}
+
+			sprintf(WAVStemFilenames[i], "%s.%d.wav", filename, i+1);
+		}
+	}
+
+	if (WAVBits == 24)
+		ahxSetOutputFormat(player, PAULA_FORMAT_S24);
+	else if (WAVBits == 32)
+		ahxSetOutputFormat(player, PAULA_FORMAT_F32);
+
+	player->isRecordingToWAV = true; // this is also set in wavRecordingThread(), but do it here to be sure...
 	if (!createSingleThread(wavRecordingThread))
 	{
 		printf("Error: Couldn't create WAV rendering thread!\n");
-		free(WAVRenderFilename);
+		freeWAVFilenames();
 		return 1;
 	}
 
@@ -389,10 +509,10 @@ static int32_t renderToWav(void)
 #ifndef _WIN32
 	modifyTerminal();
 #endif
-	while (isRecordingToWAV)
+	while (player->isRecordingToWAV)
 	{
 		if ( _kbhit())
-			isRecordingToWAV = false;
+			player->isRecordingToWAV = false;
 
 		Sleep(50);
 	}
@@ -404,6 +524,6 @@ static int32_t renderToWav(void)
 
 	closeSingleThread();
 
-	free(WAVRenderFilename);
+	freeWAVFilenames();
 	return 0;
 }
@@ -7,11 +7,11 @@
 #include "../../paula.h"
 
 static SDL_AudioDeviceID dev;
+static int32_t bytesPerFrame;
 
 static void SDLCALL audioCallback(void *userdata, Uint8 *stream, int len)
 {
-	paulaOutputSamples((int16_t *)stream, len / 4); // ../../paula.h
-	(void)userdata;
+	paulaOutputSamples((ahxPlayer_t *)userdata, (int16_t *)stream, len / bytesPerFrame); // ../../paula.h
 }
 
 void lockMixer(void)
@@ -26,7 +26,7 @@ void unlockMixer(void)
 		SDL_UnlockAudioDevice(dev);
 }
 
-bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize)
+bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize, ahxPlayer_t *player)
 {
 	SDL_AudioSpec want, have;
 
@@ -39,14 +39,17 @@ bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize)
 	memset(&want, 0, sizeof (want));
 	want.freq = mixingFrequency;
 	want.format = AUDIO_S16;
-	want.channels = 2;
+	want.channels = (uint8_t)paulaGetOutputChannels(player); // ../../paula.h
 	want.samples = (uint16_t)mixingBufferSize;
 	want.callback = audioCallback;
+	want.userdata = player;
 
 	dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
 	if (dev == 0)
 		return false;
 
+	bytesPerFrame = want.channels * sizeof (int16_t); // 8bb: SDL converts if the device has another channel count
+
 	SDL_PauseAudioDevice(dev, false);
 	return true;
 }
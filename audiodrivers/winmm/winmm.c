@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <windows.h>
 #include <mmsystem.h>
+#include <mmreg.h>
 #include "../../paula.h"
 
 #define MIX_BUF_NUM 4
@@ -21,6 +22,7 @@ static int32_t bufferSize;
 static HANDLE hThread, hAudioSem;
 static WAVEHDR waveBlocks[MIX_BUF_NUM];
 static HWAVEOUT hWave;
+static ahxPlayer_t *mixPlayer;
 
 static DWORD WINAPI mixThread(LPVOID lpParam)
 {
@@ -32,7 +34,7 @@ static DWORD WINAPI mixThread(LPVOID lpParam)
 		if (!mixerLocked)
 		{
 			mixerBusy = true;
-			paulaOutputSamples((int16_t *)waveBlock->lpData, bufferSize); // ../../paula.h
+			paulaOutputSamples(mixPlayer, (int16_t *)waveBlock->lpData, bufferSize); // ../../paula.h
 			mixerBusy = false;
 		}
 
@@ -121,10 +123,10 @@ void closeMixer(void)
 	}
 }
 
-bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize)
+bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize, ahxPlayer_t *player)
 {
 	DWORD threadID;
-	WAVEFORMATEX wfx;
+	WAVEFORMATEXTENSIBLE wfx; // 8bb: only the WAVEFORMATEX part is used for mono/stereo
 
 	// don't unprepare headers on error
 	for (int32_t i = 0; i < MIX_BUF_NUM; i++)
@@ -132,16 +134,28 @@ bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize)
 
 	closeMixer();
 	bufferSize = mixingBufferSize;
+	mixPlayer = player;
 
 	ZeroMemory(&wfx, sizeof (wfx));
-	wfx.nSamplesPerSec = mixingFrequency;
-	wfx.wBitsPerSample = 16;
-	wfx.nChannels = 2;
-	wfx.wFormatTag = WAVE_FORMAT_PCM;
-	wfx.nBlockAlign = wfx.nChannels * (wfx.wBitsPerSample / 8);
-	wfx.nAvgBytesPerSec = wfx.nSamplesPerSec * wfx.nBlockAlign;
-
-	if (waveOutOpen(&hWave, WAVE_MAPPER, &wfx, (DWORD_PTR)&waveProc, 0, CALLBACK_FUNCTION) != MMSYSERR_NOERROR)
+	wfx.Format.nSamplesPerSec = mixingFrequency;
+	wfx.Format.wBitsPerSample = 16;
+	wfx.Format.nChannels = (WORD)paulaGetOutputChannels(player); // ../../paula.h
+	wfx.Format.wFormatTag = WAVE_FORMAT_PCM;
+	wfx.Format.nBlockAlign = wfx.Format.nChannels * (wfx.Format.wBitsPerSample / 8);
+	wfx.Format.nAvgBytesPerSec = wfx.Format.nSamplesPerSec * wfx.Format.nBlockAlign;
+
+	if (wfx.Format.nChannels > 2) // 8bb: one voice per channel, needs WAVE_FORMAT_EXTENSIBLE (quad speaker layout)
+	{
+		static const GUID subTypePCM = { 0x00000001, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 } };
+
+		wfx.Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+		wfx.Format.cbSize = sizeof (WAVEFORMATEXTENSIBLE) - sizeof (WAVEFORMATEX);
+		wfx.Samples.wValidBitsPerSample = 16;
+		wfx.dwChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+		wfx.SubFormat = subTypePCM;
+	}
+
+	if (waveOutOpen(&hWave, WAVE_MAPPER, &wfx.Format, (DWORD_PTR)&waveProc, 0, CALLBACK_FUNCTION) != MMSYSERR_NOERROR)
 		goto omError;
 
 	// create semaphore for buffer fill requests
@@ -152,7 +166,7 @@ bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize)
 	// allocate WinMM mix buffers
 	for (int32_t i = 0; i < MIX_BUF_NUM; i++)
 	{
-		audioBuffer[i] = (int16_t *)calloc(mixingBufferSize, wfx.nBlockAlign);
+		audioBuffer[i] = (int16_t *)calloc(mixingBufferSize, wfx.Format.nBlockAlign);
 		if (audioBuffer[i] == NULL)
 			goto omError;
 	}
@@ -162,7 +176,7 @@ bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize)
 	for (int32_t i = 0; i < MIX_BUF_NUM; i++)
 	{
 		waveBlocks[i].lpData = (LPSTR)audioBuffer[i];
-		waveBlocks[i].dwBufferLength = mixingBufferSize * wfx.nBlockAlign;
+		waveBlocks[i].dwBufferLength = mixingBufferSize * wfx.Format.nBlockAlign;
 		waveBlocks[i].dwFlags = WHDR_DONE;
 
 		if (waveOutPrepareHeader(hWave, &waveBlocks[i], sizeof (WAVEHDR)) != MMSYSERR_NOERROR)
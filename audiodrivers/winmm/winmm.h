@@ -5,5 +5,5 @@
 
 void lockMixer(void);
 void unlockMixer(void);
-bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize);
+bool openMixer(int32_t mixingFrequency, int32_t mixingBufferSize, ahxPlayer_t *player);
 void closeMixer(void);
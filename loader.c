@@ -28,325 +28,215 @@
 	(((uint32_t)((x) & 0xFF000000)) >> 24)   \
 )
 
+// 8bb: for the module reference counter (modules can be shared between threads)
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ATOMIC_INC32(x) _InterlockedIncrement((volatile long *)(x))
+#define ATOMIC_DEC32(x) _InterlockedDecrement((volatile long *)(x))
+#else
+#define ATOMIC_INC32(x) __atomic_add_fetch((x), 1, __ATOMIC_ACQ_REL)
+#define ATOMIC_DEC32(x) __atomic_sub_fetch((x), 1, __ATOMIC_ACQ_REL)
+#endif
+
 #define READ_BYTE(x, p)  x = *(uint8_t  *)p; p += sizeof (uint8_t);
 #define READ_WORD(x, p)  x = *(uint16_t *)p; p += sizeof (uint16_t); x = SWAP16(x)
 #define READ_DWORD(x, p) x = *(uint32_t *)p; p += sizeof (uint32_t); x = SWAP32(x)
 
-extern uint8_t ahxErrCode; // 8bb: replayer.c
-
 // 8bb: AHX-header tempo value (0..3) -> Amiga PAL CIA period
 static const uint16_t tabler[4] = { 14209, 7104, 4736, 3552 };
 
-// 8bb: added +1 to all values in this table (was meant for 68k DBRA loop)
-static const uint16_t lengthTable[6+6+32+1] =
-{
-	0x04,0x08,0x10,0x20,0x40,0x80,
-	0x04,0x08,0x10,0x20,0x40,0x80,
-
-	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
-	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
-	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
-	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
-
-	WHITENOISE_LENGTH
-};
-
-static void triangleGenerate(int8_t *dst8, int16_t delta, int32_t offset, int32_t length)
-{
-	int16_t data = 0;
-	for (int32_t i = 0; i < length+1; i++)
-	{
-		*dst8++ = (uint8_t)data;
-		data += delta;
-	}
-	*dst8++ = 127;
-
-	data = 128;
-	for (int32_t i = 0; i < length; i++)
-	{
-		data -= delta;
-		*dst8++ = (uint8_t)data;
-	}
-
-	int8_t *src8 = &dst8[offset];
-	for (int32_t i = 0; i < (length+1)*2; i++)
-	{
-		int8_t sample = *src8++;
-		if (sample == 127)
-			sample = -128;
-		else
-			sample = 0 - sample;
-
-		*dst8++ = sample;
-	}
-}
-
-static void sawToothGenerate(int8_t *dst8, int32_t length)
-{
-	const int8_t delta = (int8_t)(256 / (length-1));
-
-	int8_t data = -128;
-	for (int32_t i = 0; i < length; i++)
-	{
-		*dst8++ = data;
-		data += delta;
-	}
-}
-
-static void squareGenerate(int8_t *dst8)
-{
-	uint16_t *dst16 = (uint16_t *)dst8;
-	for (int32_t i = 1; i <= 32; i++)
-	{
-		for (int32_t j = 0; j < 64-i; j++)
-			*dst16++ = 0x8080;
-
-		for (int32_t j = 0; j < i; j++)
-			*dst16++ = 0x7F7F;
-	}
-}
-
-static void whiteNoiseGenerate(int8_t *dst8, int32_t length)
+/* 8bb:
+** Estimate what filter levels a song can reach, so that only those have to be
+** generated (see ahxGenerateFilterLevels()). A filter position can be set by
+** track command 4 (on any instrument) and plist command 0, and plist command 4
+** makes it slide from there to within the instrument's limits. Odd cases that
+** this misses (f.ex. a position slid past the limits) are caught by the replayer.
+*/
+static uint32_t getFilterLevels(const ahxModule_t *module)
 {
-	uint32_t seed = 0x41595321; // 8bb: "AYS!"
+	uint32_t levels = FILTER_LEVEL_BIT(1); // 8bb: filterPos is 0 (clamped to 1) on voices that haven't played an instrument yet
+	int32_t trackMin = 32, trackMax = 32;
 
-	for (int32_t i = 0; i < length; i++)
+	const uint8_t *ptr8;
+	for (int32_t i = 0; i <= module->highestTrack; i++)
 	{
-		if (!(seed & 256))
-			*dst8++ = (uint8_t)seed;
-		else if (seed & 0x8000)
-			*dst8++ = -128;
-		else
-			*dst8++ = 127;
-
-		ROR32(seed, 5);
-		seed ^= 0b10011010;
-		uint16_t tmp16 = (uint16_t)seed;
-		ROL32(seed, 2);
-		tmp16 += (uint16_t)seed;
-		seed ^= tmp16;
-		ROR32(seed, 3);
-	}
-}
+		for (int32_t j = 0; j < module->TrackLength; j++)
+		{
+			ptr8 = &module->TrackTable[((i << 6) + j) * 3];
+			if ((ptr8[1] & 0x0F) != 4) // FX: OVERRIDE FILTER!
+				continue;
 
-static inline int32_t fp16Clip(int32_t x)
-{
-	int16_t fp16Int = x >> 16;
+			const int32_t pos = (ptr8[2] < 0x40) ? ptr8[2] : (ptr8[2] - 0x40);
+			if (pos == 0)
+				continue; // 8bb: doesn't do anything
 
-	if (fp16Int > 127)
-	{
-		fp16Int = 127;
-		return fp16Int << 16;
+			levels |= FILTER_LEVEL_BIT(pos);
+			if (pos < trackMin) trackMin = pos;
+			if (pos > trackMax) trackMax = pos;
+		}
 	}
 
-	if (fp16Int < -128)
+	for (int32_t i = 0; i < module->numInstruments; i++)
 	{
-		fp16Int = -128;
-		return fp16Int << 16;
-	}
+		const instrument_t *ins = module->Instruments[i];
+		if (ins == NULL)
+			continue;
 
-	return x;
-}
+		int32_t posMin = trackMin, posMax = trackMax;
+		bool filterModulation = false;
 
-static void setUpFilterWaveForms(void)
-{
-	int8_t *dst8Hi = waves->highPasses;
-	int8_t *dst8Lo = waves->lowPasses;
-	
-	int32_t d5 = ((((8<<16)*125)/100)/100)>>8;
-	for (int32_t i = 0; i < 31; i++)
-	{
-		int8_t *src8 =  waves->triangle04; // 8bb: beginning of waveforms
-		for (int32_t j = 0; j < 6+6+32+1; j++)
+		ptr8 = ins->perfList;
+		for (int32_t j = 0; j < ins->perfLength; j++, ptr8 += 4)
 		{
-			const int32_t waveLength = lengthTable[j];
-			
-			int32_t d1;
-			int32_t d2 = 0;
-			int32_t d3 = 0;
-
-			// 8bb: 1st pass
-			for (int32_t k = 0; k < waveLength; k++)
+			for (int32_t k = 0; k < 2; k++)
 			{
-				const int32_t d0 = (int16_t)src8[k] << 16;
+				const uint8_t cmd = (k == 0) ? ((ptr8[0] >> 2) & 7) : ((ptr8[0] >> 5) & 7);
+				const uint8_t param = ptr8[2+k];
 
-				d1 = fp16Clip(d0 - d2 - d3);
-				d2 = fp16Clip(d2 + ((d1 >> 8) * d5));
-				d3 = fp16Clip(d3 + ((d2 >> 8) * d5));
-			}
+				if (cmd == 0 && param != 0) // 8bb: Init Filter Modulation
+				{
+					const int32_t pos = CLAMP(param, 1, 63);
 
-			// 8bb: 2nd pass
-			for (int32_t k = 0; k < waveLength; k++)
-			{
-				const int32_t d0 = (int16_t)src8[k] << 16;
+					levels |= FILTER_LEVEL_BIT(pos);
+					if (pos < posMin) posMin = pos;
+					if (pos > posMax) posMax = pos;
 
-				d1 = fp16Clip(d0 - d2 - d3);
-				d2 = fp16Clip(d2 + ((d1 >> 8) * d5));
-				d3 = fp16Clip(d3 + ((d2 >> 8) * d5));
+					if (param > 63)
+						posMin = 1; // 8bb: modulation can wrap around from there
+				}
+				else if (cmd == 4 && (param & 0xF0)) // 8bb: Filter Modulation on/off
+				{
+					filterModulation = true;
+				}
 			}
+		}
 
-			// 8bb: 3rd pass
-			for (int32_t k = 0; k < waveLength; k++)
-			{
-				const int32_t d0 = (int16_t)src8[k] << 16;
-
-				d1 = fp16Clip(d0 - d2 - d3);
-				d2 = fp16Clip(d2 + ((d1 >> 8) * d5));
-				d3 = fp16Clip(d3 + ((d2 >> 8) * d5));
-			}
-			
-			/* 8bb:
-			** Truncate lower 8 bits so that it's bit-accurate
-			** to how AHX does it (it uses a bit-reduced LUT).
-			*/
-			d2 &= ~0xFF;
-			d3 &= ~0xFF;
-
-			// 8bb: 4th pass (also writes to output)
-			for (int32_t k = 0; k < waveLength; k++)
-			{
-				const int32_t d0 = (int16_t)src8[k] << 16;
+		if (!filterModulation)
+			continue;
 
-				d1 = fp16Clip(d0 - d2 - d3);
-				d2 = fp16Clip(d2 + ((d1 >> 8) * d5));
-				d3 = fp16Clip(d3 + ((d2 >> 8) * d5));
+		int32_t lowerLimit = ins->filterLowerLimit & ~128;
+		int32_t upperLimit = ins->filterUpperLimit & ~128;
+		if (lowerLimit > upperLimit)
+		{
+			const int32_t tmp = lowerLimit;
+			lowerLimit = upperLimit;
+			upperLimit = tmp;
+		}
 
-				*dst8Hi++ = (uint8_t)(d1 >> 16);
-				*dst8Lo++ = (uint8_t)(d3 >> 16);
-			}
+		if (lowerLimit < posMin) posMin = lowerLimit;
+		if (upperLimit > posMax) posMax = upperLimit;
 
-			src8 += waveLength; // 8bb: go to next waveform
-		}
+		// 8bb: +/- 1 for the step that turns the modulation around
+		posMin = CLAMP(posMin-1, 1, 63);
+		posMax = CLAMP(posMax+1, 1, 63);
 
-		d5 += ((((3<<16)*125)/100)/100)>>8;
+		for (int32_t pos = posMin; pos <= posMax; pos++)
+			levels |= FILTER_LEVEL_BIT(pos);
 	}
-}
 
-void ahxFreeWaves(void)
-{
-	if (waves != NULL)
-	{
-		free(waves);
-		waves = NULL;
-	}
+	return levels;
 }
 
-bool ahxInitWaves(void) // 8bb: this generates bit-accurate AHX 2.3d-sp3 waveforms
+static void freeModule(ahxModule_t *module)
 {
-	ahxFreeWaves();
+	if (module->SubSongTable != NULL)
+		free(module->SubSongTable);
 
-	// 8bb: "waves" needs dword-alignment, and that's guaranteed from malloc()
-	waves = (waveforms_t *)malloc(sizeof (waveforms_t));
-	if (waves == NULL)
-		return false;
+	if (module->PosTable != NULL)
+		free(module->PosTable);
 
-	// 8bb: generate waveforms
+	if (module->TrackTable != NULL)
+		free(module->TrackTable);
 
-	int8_t *dst8 =  waves->triangle04;
-	for (int32_t i = 0; i < 6; i++)
+	for (int32_t i = 0; i < module->numInstruments; i++)
 	{
-		uint16_t fullLength = 4 << i;
-		uint16_t length = fullLength >> 2;
-		uint16_t delta = 128 / length;
-		int32_t offset = 0 - (fullLength >> 1);
-
-		triangleGenerate(dst8, delta, offset, length-1);
-		dst8 += fullLength;
+		if (module->Instruments[i] != NULL)
+			free(module->Instruments[i]);
 	}
 
-	sawToothGenerate(waves->sawtooth04, 0x04);
-	sawToothGenerate(waves->sawtooth08, 0x08);
-	sawToothGenerate(waves->sawtooth10, 0x10);
-	sawToothGenerate(waves->sawtooth20, 0x20);
-	sawToothGenerate(waves->sawtooth40, 0x40);
-	sawToothGenerate(waves->sawtooth80, 0x80);
-	squareGenerate(waves->squares);
-	whiteNoiseGenerate(waves->whiteNoiseBig, WHITENOISE_LENGTH);
-
-	setUpFilterWaveForms();
-	return true;
+	free(module);
 }
 
-static bool ahxInitModule(const uint8_t *p)
+static ahxModule_t *ahxInitModule(const uint8_t *p, int32_t *errCode)
 {
 	bool trkNullEmpty;
 	uint16_t flags;
 
-	song.songLoaded = false;
-
-	// 8bb: added this check
-	if (waves == NULL)
+	// 8bb: calloc is needed here, so that freeModule() is safe on a half-loaded module
+	ahxModule_t *module = (ahxModule_t *)calloc(1, sizeof (ahxModule_t));
+	if (module == NULL)
 	{
-		ahxErrCode = ERR_NO_WAVES;
-		return false;
+		*errCode = ERR_OUT_OF_MEMORY;
+		return NULL;
 	}
 
-	song.Revision = p[3];
+	module->Revision = p[3];
 
-	if (memcmp("THX", p, 3) != 0 || song.Revision > 1) // 8bb: added revision check
+	if (memcmp("THX", p, 3) != 0 || module->Revision > 1) // 8bb: added revision check
 	{
-		ahxErrCode = ERR_NOT_AN_AHX;
-		return false;
+		freeModule(module);
+		*errCode = ERR_NOT_AN_AHX;
+		return NULL;
 	}
 
 	p += 6;
 
 	READ_WORD(flags, p);
 	trkNullEmpty = !!(flags & 32768);
-	song.LenNr = flags & 0x3FF;
-	READ_WORD(song.ResNr, p);
-	READ_BYTE(song.TrackLength, p);
-	READ_BYTE(song.highestTrack, p); // max track nr. like 0
-	READ_BYTE(song.numInstruments, p); // max instr nr. 0/1-63
-	READ_BYTE(song.Subsongs, p);
-	uint32_t numTracks = song.highestTrack + 1;
+	module->LenNr = flags & 0x3FF;
+	READ_WORD(module->ResNr, p);
+	READ_BYTE(module->TrackLength, p);
+	READ_BYTE(module->highestTrack, p); // max track nr. like 0
+	READ_BYTE(module->numInstruments, p); // max instr nr. 0/1-63
+	READ_BYTE(module->Subsongs, p);
+	uint32_t numTracks = module->highestTrack + 1;
 
-	if (song.ResNr >= song.LenNr) // 8bb: safety bug-fix...
-		song.ResNr = 0;
+	if (module->ResNr >= module->LenNr) // 8bb: safety bug-fix...
+		module->ResNr = 0;
 
 	// 8bb: read sub-song table
-	const int32_t subSongTableBytes = song.Subsongs << 1;
+	const int32_t subSongTableBytes = module->Subsongs << 1;
 
-	song.SubSongTable = (uint16_t *)malloc(subSongTableBytes);
-	if (song.SubSongTable == NULL)
+	module->SubSongTable = (uint16_t *)malloc(subSongTableBytes);
+	if (module->SubSongTable == NULL)
 	{
-		ahxFree();
-		ahxErrCode = ERR_OUT_OF_MEMORY;
-		return false;
+		freeModule(module);
+		*errCode = ERR_OUT_OF_MEMORY;
+		return NULL;
 	}
 
 	const uint16_t *ptr16 = (uint16_t *)p;
-	for (int32_t i = 0; i < song.Subsongs; i++)
-		song.SubSongTable[i] = SWAP16(ptr16[i]);
+	for (int32_t i = 0; i < module->Subsongs; i++)
+		module->SubSongTable[i] = SWAP16(ptr16[i]);
 	p += subSongTableBytes;
 
 
 	// 8bb: read position table
-	const int32_t posTableBytes = song.LenNr << 3;
+	const int32_t posTableBytes = module->LenNr << 3;
 
-	song.PosTable = (uint8_t *)malloc(posTableBytes);
-	if (song.PosTable == NULL)
+	module->PosTable = (uint8_t *)malloc(posTableBytes);
+	if (module->PosTable == NULL)
 	{
-		ahxFree();
-		ahxErrCode = ERR_OUT_OF_MEMORY;
-		return false;
+		freeModule(module);
+		*errCode = ERR_OUT_OF_MEMORY;
+		return NULL;
 	}
 
 	for (int32_t i = 0; i < posTableBytes; i++)
-		song.PosTable[i] = *p++;
+		module->PosTable[i] = *p++;
 
 
 	// 8bb: read track table
-	song.TrackTable = (uint8_t *)calloc(numTracks, 3*64);
-	if (song.TrackTable == NULL)
+	module->TrackTable = (uint8_t *)calloc(numTracks, 3*64);
+	if (module->TrackTable == NULL)
 	{
-		ahxFree();
-		ahxErrCode = ERR_OUT_OF_MEMORY;
-		return false;
+		freeModule(module);
+		*errCode = ERR_OUT_OF_MEMORY;
+		return NULL;
 	}
 
 	int32_t tracksToRead = numTracks;
-	uint8_t *dst8 = song.TrackTable;
+	uint8_t *dst8 = module->TrackTable;
 
 	if (trkNullEmpty)
 	{
@@ -356,7 +246,7 @@ static bool ahxInitModule(const uint8_t *p)
 	
 	if (tracksToRead > 0)
 	{
-		const int32_t trackBytes = song.TrackLength * 3;
+		const int32_t trackBytes = module->TrackLength * 3;
 		for (int32_t i = 0; i < tracksToRead; i++)
 		{
 			memcpy(&dst8[i * 3 * 64], p, trackBytes);
@@ -365,43 +255,43 @@ static bool ahxInitModule(const uint8_t *p)
 	}
 
 	// 8bb: read instruments
-	for (int32_t i = 0; i < song.numInstruments; i++)
+	for (int32_t i = 0; i < module->numInstruments; i++)
 	{
 		instrument_t *ins = (instrument_t *)p;
 
 		const int32_t instrBytes = 22 + (ins->perfLength << 2);
 
 		// 8bb: calloc is needed here, to clear all non-written perfList bytes!
-		song.Instruments[i] = (instrument_t *)calloc(1, sizeof (instrument_t));
-		if (song.Instruments[i] == NULL)
+		module->Instruments[i] = (instrument_t *)calloc(1, sizeof (instrument_t));
+		if (module->Instruments[i] == NULL)
 		{
-			ahxFree();
-			ahxErrCode = ERR_OUT_OF_MEMORY;
-			return false;
+			freeModule(module);
+			*errCode = ERR_OUT_OF_MEMORY;
+			return NULL;
 		}
 
-		memcpy(song.Instruments[i], p, instrBytes);
+		memcpy(module->Instruments[i], p, instrBytes);
 		p += instrBytes;
 	}
 
-	song.Name[255] = '\0';
+	module->Name[255] = '\0';
 	for (int32_t i = 0; i < 255; i++)
 	{
-		song.Name[i] = (char)p[i];
-		if (song.Name[i] == '\0')
+		module->Name[i] = (char)p[i];
+		if (module->Name[i] == '\0')
 			break;
 	}
 
 	// 8bb: remove filter commands on rev-0 songs, if present (AHX does this)
-	if (song.Revision == 0)
+	if (module->Revision == 0)
 	{
 		uint8_t *ptr8;
 
 		// 8bb: clear command 4 (override filter) parameter
-		ptr8 = song.TrackTable;
-		for (int32_t i = 0; i <= song.highestTrack; i++)
+		ptr8 = module->TrackTable;
+		for (int32_t i = 0; i <= module->highestTrack; i++)
 		{
-			for (int32_t j = 0; j < song.TrackLength; j++)
+			for (int32_t j = 0; j < module->TrackLength; j++)
 			{
 				const uint8_t fx = ptr8[1] & 0x0F;
 				if (fx == 4) // FX: OVERRIDE FILTER!
@@ -415,9 +305,9 @@ static bool ahxInitModule(const uint8_t *p)
 		}
 
 		// 8bb: clear command 0/4 parameter in instrument plists
-		for (int32_t i = 0; i < song.numInstruments; i++)
+		for (int32_t i = 0; i < module->numInstruments; i++)
 		{
-			instrument_t *ins = song.Instruments[i];
+			instrument_t *ins = module->Instruments[i];
 			if (ins == NULL)
 				continue;
 
@@ -438,15 +328,12 @@ static bool ahxInitModule(const uint8_t *p)
 	}
 
 	// 8bb: added this (BPM/tempo)
-	song.SongCIAPeriod = tabler[(flags >> 13) & 3];
+	module->SongCIAPeriod = tabler[(flags >> 13) & 3];
 
-	// 8bb: set up waveform pointers (Note: song.WaveformTab[2] gets initialized in the replayer!)
-	song.WaveformTab[0] = waves->triangle04;
-	song.WaveformTab[1] = waves->sawtooth04;
-	song.WaveformTab[3] = waves->whiteNoiseBig;
+	module->filterLevels = getFilterLevels(module); // 8bb: after the rev-0 fixes above
 
 	// 8bb: Added this. Set default values for EmptyInstrument (used for non-loaded instruments in replayer)
-	instrument_t *ins = &song.EmptyInstrument;
+	instrument_t *ins = &module->EmptyInstrument;
 	memset(ins, 0, sizeof (instrument_t));
 	ins->aFrames = 1;
 	ins->dFrames = 1;
@@ -461,31 +348,47 @@ static bool ahxInitModule(const uint8_t *p)
 	ins->filterSpeedWavelength = 4<<3; // fs 3 wl 04 !!
 	// ----------------------------------------------------
 
-	song.songLoaded = true;
-	return true;
+	module->refCount = 1;
+	return module;
 }
 
-bool ahxLoadFromRAM(const uint8_t *data)
+ahxModule_t *ahxRetainModule(ahxModule_t *module)
 {
-	ahxErrCode = ERR_SUCCESS;
-	if (!ahxInitModule(data))
-	{
-		ahxFree();
-		return false;
-	}
+	if (module != NULL)
+		ATOMIC_INC32(&module->refCount);
 
-	return true;
+	return module;
+}
+
+void ahxReleaseModule(ahxModule_t *module)
+{
+	if (module != NULL && ATOMIC_DEC32(&module->refCount) == 0)
+		freeModule(module);
 }
 
-bool ahxLoad(const char *filename)
+ahxModule_t *ahxLoadModuleFromRAM(const uint8_t *data, int32_t *errCode)
 {
-	ahxErrCode = ERR_SUCCESS;
+	int32_t dummyErrCode;
+	if (errCode == NULL)
+		errCode = &dummyErrCode;
+
+	*errCode = ERR_SUCCESS;
+	return ahxInitModule(data, errCode);
+}
+
+ahxModule_t *ahxLoadModule(const char *filename, int32_t *errCode)
+{
+	int32_t dummyErrCode;
+	if (errCode == NULL)
+		errCode = &dummyErrCode;
+
+	*errCode = ERR_SUCCESS;
 
 	FILE *f = fopen(filename, "rb");
 	if (f == NULL)
 	{
-		ahxErrCode = ERR_FILE_IO;
-		return false;
+		*errCode = ERR_FILE_IO;
+		return NULL;
 	}
 
 	fseek(f, 0, SEEK_END);
@@ -496,51 +399,97 @@ bool ahxLoad(const char *filename)
 	if (fileBuffer == NULL)
 	{
 		fclose(f);
-		ahxErrCode = ERR_OUT_OF_MEMORY;
-		return false;
+		*errCode = ERR_OUT_OF_MEMORY;
+		return NULL;
 	}
 
 	if (fread(fileBuffer, 1, filesize, f) != filesize)
 	{
 		free(fileBuffer);
 		fclose(f);
-		ahxErrCode = ERR_FILE_IO;
-		return false;
+		*errCode = ERR_FILE_IO;
+		return NULL;
 	}
 
 	fclose(f);
 
-	if (!ahxLoadFromRAM((const uint8_t *)fileBuffer))
+	ahxModule_t *module = ahxInitModule((const uint8_t *)fileBuffer, errCode);
+
+	free(fileBuffer);
+	return module;
+}
+
+bool ahxSetModule(ahxPlayer_t *player, ahxModule_t *module)
+{
+	ahxFree(player);
+
+	player->errCode = ERR_SUCCESS;
+
+	if (module == NULL)
 	{
-		free(fileBuffer);
+		player->errCode = ERR_SONG_NOT_LOADED;
 		return false;
 	}
 
-	free(fileBuffer);
+	// 8bb: added this check
+	if (player->waves == NULL)
+	{
+		player->errCode = ERR_NO_WAVES;
+		return false;
+	}
+
+	/* 8bb: Generate the filter levels this song needs now, instead of when the mixer
+	** first hits them. The mixer doesn't run the replayer for this player until ahxPlay().
+	*/
+	ahxGenerateFilterLevels(player, module->filterLevels);
+
+	player->module = ahxRetainModule(module);
 	return true;
 }
 
-void ahxFree(void)
+bool ahxLoadFromRAM(ahxPlayer_t *player, const uint8_t *data)
 {
-	ahxStop();
-	paulaSetDMACON(0); // 8bb: stop all Paula voice DMAs
+	int32_t errCode;
 
-	// 8bb: song can be free'd now
+	ahxModule_t *module = ahxLoadModuleFromRAM(data, &errCode);
+	if (module == NULL)
+	{
+		ahxFree(player);
+		player->errCode = (uint8_t)errCode;
+		return false;
+	}
 
-	if (song.SubSongTable != NULL)
-		free(song.SubSongTable);
+	const bool result = ahxSetModule(player, module);
+	ahxReleaseModule(module); // 8bb: the player holds its own reference now
 
-	if (song.PosTable != NULL)
-		free(song.PosTable);
+	return result;
+}
 
-	if (song.TrackTable != NULL)
-		free(song.TrackTable);
+bool ahxLoad(ahxPlayer_t *player, const char *filename)
+{
+	int32_t errCode;
 
-	for (int32_t i = 0; i < song.numInstruments; i++)
+	ahxModule_t *module = ahxLoadModule(filename, &errCode);
+	if (module == NULL)
 	{
-		if (song.Instruments[i] != NULL)
-			free(song.Instruments[i]);
+		ahxFree(player);
+		player->errCode = (uint8_t)errCode;
+		return false;
 	}
 
-	memset(&song, 0, sizeof (song));
+	const bool result = ahxSetModule(player, module);
+	ahxReleaseModule(module); // 8bb: the player holds its own reference now
+
+	return result;
+}
+
+void ahxFree(ahxPlayer_t *player)
+{
+	ahxModule_t *module = player->module;
+
+	// 8bb: the mixer must be done with the song before it can be released (this doesn't lock the audio device)
+	detachModule(player);
+
+	// 8bb: song can be released now (it's only free'd when no other player is using it)
+	ahxReleaseModule(module);
 }
@@ -17,57 +17,70 @@
 #include <string.h>
 #include "paula.h" // PAULA_VOICES
 #include <math.h>
-#include "replayer.h" // tickReplayer(), AHX_DEFAULT_CIA_PERIOD
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h> // QueryPerformanceCounter()
+#else
+#include <time.h> // clock_gettime()
+#endif
+#include "replayer.h" // runReplayerBlock(), processCommandQueue(), AHX_DEFAULT_CIA_PERIOD
+
+// 8bb: SSE2 is always there on x86-64, the four voices are mixed in SIMD lanes then (see paulaGenerateSamples())
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PAULA_SSE2
+#endif
+
+/* 8bb: AVX2/AVX-512 kernels are compiled per function, so that the same binary runs on any
+** x86 CPU. The instruction set is picked at runtime (see paulaGetCPUSIMD()).
+*/
+#if defined PAULA_SSE2 && defined __clang__
+#include <immintrin.h>
+#define PAULA_AVX
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw")))
+#elif defined PAULA_SSE2 && defined __GNUC__
+#include <immintrin.h>
+#define PAULA_AVX
+#define TARGET_AVX2 __attribute__((target("avx2")))
+// 8bb: AVX-512F has FMA, and GCC would fuse mul/add pairs, which rounds differently than the other kernels
+#define TARGET_AVX512 __attribute__((target("avx2,avx512f,avx512bw"), optimize("fp-contract=off")))
+#elif defined PAULA_SSE2 && defined _MSC_VER && _MSC_VER >= 1910
+#include <intrin.h> // __cpuid()
+#include <immintrin.h>
+#define PAULA_AVX
+#define TARGET_AVX2
+#define TARGET_AVX512
+#endif
+
+// 8bb: for mixer loops that are specialized by constant parameters (see paulaGenerateSamples())
+#ifdef _MSC_VER
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
 
 #define MAX_SAMPLE_LENGTH (0x280/2) /* in words. AHX buffer size */
 #define AUDIO_GAIN 1.75f /* this is a good value between loudness and clipping */
 #define STEREO_NORM_FACTOR 0.5f /* cumulative mid/side normalization factor (1/sqrt(2))*(1/sqrt(2)) */
 #define INITIAL_DITHER_SEED 0x12345000
 
-static int8_t nullSample[MAX_SAMPLE_LENGTH*2];
-static uint32_t randSeed = INITIAL_DITHER_SEED;
-static float *fMixBufferL, *fMixBufferR, fPrngStateL, fPrngStateR, fSideFactor, fPeriodToDeltaDiv, fMixNormalize;
+// 8bb: adaptive quality thresholds (see adaptiveQuality_t)
+#define ADAPT_HEAVY_BLOCKS 2 /* step down after this many callbacks in a row that used >= 75% of their time budget... */
+#define ADAPT_LIGHT_SECONDS 4 /* ...and step up again after this many seconds of callbacks that used < 50% */
 
-// globalized
-audio_t audio;
-paulaVoice_t paula[PAULA_VOICES];
+static const int8_t nullSample[MAX_SAMPLE_LENGTH*2]; // 8bb: read-only, safe to share between players
 
 // -----------------------------------------------
 // -----------------------------------------------
 
 /*
 ** BLEP synthesis (coded by aciddose)
+** (BLEP constants and blep_t are in paula.h)
 */
 
-/* aciddose:
-** information on blep variables
-**
-** ZC = zero crossings, the number of ripples in the impulse
-** OS = oversampling, how many samples per zero crossing are taken
-** SP = step size per output sample, used to lower the cutoff (play the impulse slower)
-** NS = number of samples of impulse to insert
-** RNS = the lowest power of two greater than NS, minus one (used to wrap output buffer)
-**
-** ZC and OS are here only for reference, they depend upon the data in the table and can't be changed.
-** SP, the step size can be any number lower or equal to OS, as long as the result NS remains an integer.
-** for example, if ZC=8,OS=5, you can set SP=1, the result is NS=40, and RNS must then be 63.
-** the result of that is the filter cutoff is set at nyquist * (SP/OS), in this case nyquist/5.
-*/
-
-#define BLEP_ZC 16
-#define BLEP_OS 16
-#define BLEP_SP 16
-#define BLEP_NS (BLEP_ZC * BLEP_OS / BLEP_SP)
-#define BLEP_RNS 31 // RNS = (2^ > NS) - 1
-
-typedef struct blep_t
-{
-	int32_t index, samplesLeft;
-	float fBuffer[BLEP_RNS+1], fLastValue;
-} blep_t;
-
-static blep_t blep[PAULA_VOICES];
-
 static const float fMinBlepData[256+1] = // zero-crossings = 16, oversampling = 16
 {
 	 1.0000477302613517416f, 1.0000703265259194286f, 1.0000262954869634235f, 0.9999104247733368034f,
@@ -138,27 +151,73 @@ static const float fMinBlepData[256+1] = // zero-crossings = 16, oversampling =
 	 0.0000000000000000000f // copy of last point required for interpolation
 };
 
-// linear interpolation macro
-#define LERP(p1, p2, frac) ((p1) + (((p2) - (p1)) * (frac)))
+// 8bb: shorter minimum-phase BLEP (Blackman windowed sinc) for PAULA_QUALITY_SHORT_BLEP
+static const float fMinBlepDataShort[128+1] = // zero-crossings = 8, oversampling = 16
+{
+	 0.9999987390903000151f, 0.9999919546592238584f, 0.9999703475443783018f, 0.9999170998974251656f,
+	 0.9998049525952498184f, 0.9995929171846527073f, 0.9992227390588152014f, 0.9986152688764240448f,
+	 0.9976669589069403488f, 0.9962467378325055023f, 0.9941935449009838832f, 0.9913148077232055710f,
+	 0.9873861504609007245f, 0.9821526007687051418f, 0.9753315281271323078f, 0.9666174770185753662f,
+	 0.9556889746082866122f, 0.9422172922238685189f, 0.9258770347968587888f, 0.9063583125408209984f,
+	 0.8833801286277922493f, 0.8567045006613207558f, 0.8261507414607347499f, 0.7916092533135323794f,
+	 0.7530541467461387972f, 0.7105539789214232460f, 0.6642799323585537596f, 0.6145108207239745601f,
+	 0.5616344160118401652f, 0.5061447283031168531f, 0.4486350356271133766f, 0.3897866501819853280f,
+	 0.3303536145386115619f, 0.2711437290743708983f, 0.2129965083839241435f, 0.1567588367190528853f,
+	 0.1032592376310720317f, 0.0532817792986591821f, 0.0075406963610322730f,-0.0333431886440680447f,
+	-0.0688632127745860689f,-0.0986438606625148484f,-0.1224532128056456948f,-0.1402102667042346429f,
+	-0.1519867707258764078f,-0.1580034600089941232f,-0.1586208371723780708f,-0.1543248874217466593f,
+	-0.1457083469290403333f,-0.1334483453871064818f,-0.1182814033762393802f,-0.1009768731554434584f,
+	-0.0823099631396264630f,-0.0630354841099012297f,-0.0438633991695938086f,-0.0254371508305744065f,
+	-0.0083155813263744438f, 0.0070409314727225558f, 0.0202797166588146727f, 0.0311602528431660364f,
+	 0.0395538617936969095f, 0.0454389250949935875f, 0.0488920939181720637f, 0.0500761250617860476f,
+	 0.0492250986214057829f, 0.0466278527654492292f, 0.0426105073228758569f, 0.0375189375585431861f,
+	 0.0317020030139587572f, 0.0254962413198178695f, 0.0192126134666062987f, 0.0131257439177453472f,
+	 0.0074659412820904381f, 0.0024141216775100949f,-0.0019004015816235231f,-0.0053994395652425808f,
+	-0.0080530573864474597f,-0.0098747033629817960f,-0.0109147979132968587f,-0.0112532794751121212f,
+	-0.0109916092461062043f,-0.0102447109464500752f,-0.0091332749613919351f,-0.0077767913169650704f,
+	-0.0062875968658921977f,-0.0047661308976445493f,-0.0032975009049822646f,-0.0019493733791939860f,
+	-0.0007711297757417857f, 0.0002058373785744916f, 0.0009668649872879298f, 0.0015120096239367165f,
+	 0.0018535153495892187f, 0.0020129855180919254f, 0.0020184700068353045f, 0.0019016573025369965f,
+	 0.0016953273523645507f, 0.0014311805574209746f, 0.0011381127280090109f, 0.0008409669553882670f,
+	 0.0005597591338171171f, 0.0003093465532645334f, 0.0000994826226178303f,-0.0000648154408455781f,
+	-0.0001826670217515147f,-0.0002565735881900899f,-0.0002915827644016655f,-0.0002944376602485033f,
+	-0.0002727716183956730f,-0.0002343918771825493f,-0.0001866807655293012f,-0.0001361281060052733f,
+	-0.0000880042242088486f,-0.0000461737867314405f,-0.0000130438135370614f, 0.0000103731106838589f,
+	 0.0000242979130924414f, 0.0000299444257596537f, 0.0000292131169317145f, 0.0000243468288809723f,
+	 0.0000175810075805360f, 0.0000108292812335264f, 0.0000054326923651926f, 0.0000020090995532795f,
+	 0.0000004388293114443f, 0.0000000445574226404f, 0.0000000020758712527f, 0.0000000000000000000f,
+
+	 0.0000000000000000000f // copy of last point required for interpolation
+};
+
+static void setUpBlepTaps(blepTaps_t *t, const float *fBlepData, int32_t blepLength)
+{
+	memset(t, 0, sizeof (blepTaps_t));
+	for (int32_t i = 0; i < BLEP_SP; i++)
+	{
+		const float *fBlepSrc = &fBlepData[i];
+		for (int32_t n = 0; n < blepLength; n++, fBlepSrc += BLEP_SP)
+		{
+			t->fTap[i][n] = fBlepSrc[0];
+			t->fSlope[i][n] = fBlepSrc[1] - fBlepSrc[0]; // 8bb: for linear interpolation between the two points
+		}
+	}
+}
 
-static void inline blepAdd(blep_t *b, const float fOffset, const float fAmplitude)
+static void inline blepAdd(blep_t *b, const blepTaps_t *t, const int32_t blepLength, const float fOffset, const float fAmplitude)
 {
 	float f = fOffset * BLEP_SP;
 
 	const int32_t fInt = (int32_t)f; // get integer part of f
-	const float *fBlepSrc = fMinBlepData + fInt;
+	const float *fTap = t->fTap[fInt];
+	const float *fSlope = t->fSlope[fInt];
 	f -= fInt; // remove integer part from f
 
-	int32_t i = b->index;
-	for (int32_t n = 0; n < BLEP_NS; n++)
-	{
-		b->fBuffer[i] += fAmplitude * LERP(fBlepSrc[0], fBlepSrc[1], f);
-		fBlepSrc += BLEP_SP;
-
-		i = (i + 1) & BLEP_RNS;
-	}
+	float *fBuffer = &b->fBuffer[b->index]; // 8bb: never wraps (see blep_t)
+	for (int32_t n = 0; n < blepLength; n++)
+		fBuffer[n] += fAmplitude * (fTap[n] + (fSlope[n] * f));
 
-	b->samplesLeft = BLEP_NS;
+	b->samplesLeft = blepLength;
 }
 
 static float inline blepRun(blep_t *b, const float fInput)
@@ -166,30 +225,110 @@ static float inline blepRun(blep_t *b, const float fInput)
 	float fBlepOutput = fInput + b->fBuffer[b->index];
 	b->fBuffer[b->index] = 0.0f;
 
-	b->index = (b->index + 1) & BLEP_RNS;
+	if (++b->index > BLEP_RNS) // 8bb: end of window, slide the second half down
+	{
+		memcpy(&b->fBuffer[0], &b->fBuffer[BLEP_RNS+1], BLEP_NS * sizeof (float));
+		memset(&b->fBuffer[BLEP_RNS+1], 0, BLEP_NS * sizeof (float));
+		b->index = 0;
+	}
 
 	b->samplesLeft--;
 	return fBlepOutput;
 }
 
+/* 8bb: Fixed-point BLEP for the integer mixer (see paulaSetFixedPoint()).
+** The taps are rounded to 1.15 once at init, so the tables (and thus the output) are the same
+** on every platform. The offset is in 4.16 (BLEP phase and fraction), and the buffer holds
+** sample points (-128..127 * 0..64) in 24.8.
+*/
+static void setUpBlepTapsFixed(blepTapsFixed_t *t, const float *fBlepData, int32_t blepLength)
+{
+	memset(t, 0, sizeof (blepTapsFixed_t));
+	for (int32_t i = 0; i < BLEP_SP; i++)
+	{
+		const float *fBlepSrc = &fBlepData[i];
+		for (int32_t n = 0; n < blepLength; n++, fBlepSrc += BLEP_SP)
+		{
+			const int32_t tap1 = (int32_t)floor((fBlepSrc[0] * 32768.0) + 0.5);
+			const int32_t tap2 = (int32_t)floor((fBlepSrc[1] * 32768.0) + 0.5);
+
+			t->tap[i][n] = tap1;
+			t->slope[i][n] = tap2 - tap1;
+		}
+	}
+}
+
+static inline void blepAddFixed(blep_t *b, const blepTapsFixed_t *t, const int32_t blepLength, const uint32_t offset, const int32_t amplitude)
+{
+	const int32_t *tap = t->tap[offset >> 16];
+	const int32_t *slope = t->slope[offset >> 16];
+	const int32_t frac = offset & 0xFFFF;
+
+	int32_t *buffer = &b->buffer[b->index]; // 8bb: never wraps (see blep_t)
+	for (int32_t n = 0; n < blepLength; n++)
+		buffer[n] += (amplitude * (tap[n] + ((slope[n] * frac) >> 16))) >> 7; // 1.15 -> 24.8
+
+	b->samplesLeft = blepLength;
+}
+
+static inline int32_t blepRunFixed(blep_t *b, const int32_t input)
+{
+	const int32_t blepOutput = input + b->buffer[b->index];
+	b->buffer[b->index] = 0;
+
+	if (++b->index > BLEP_RNS)
+	{
+		memcpy(&b->buffer[0], &b->buffer[BLEP_RNS+1], BLEP_NS * sizeof (int32_t));
+		memset(&b->buffer[BLEP_RNS+1], 0, BLEP_NS * sizeof (int32_t));
+		b->index = 0;
+	}
+
+	b->samplesLeft--;
+	return blepOutput;
+}
+
 // -----------------------------------------------
 // -----------------------------------------------
 
-void paulaSetMasterVolume(int32_t vol) // 0..256
+void paulaSetMasterVolume(paula_t *paula, int32_t vol) // 0..256
 {
-	audio.masterVol = CLAMP(vol, 0, 256);
+	paula->audio.masterVol = CLAMP(vol, 0, 256);
 
 	// normalization multiplier
-	fMixNormalize = (float)(AUDIO_GAIN * ((INT16_MAX+1.0) / PAULA_VOICES)) * (audio.masterVol / 256.0f);
+	paula->fMixNormalize = (float)(AUDIO_GAIN * ((INT16_MAX+1.0) / PAULA_VOICES)) * (paula->audio.masterVol / 256.0f);
+
+	// 8bb: same for the fixed-point mixer: 24.8 sample point (-128..127 * 0..64) -> 16.16 (AUDIO_GAIN*256 = 448)
+	paula->mixNormalize = (int32_t)(AUDIO_GAIN * 256.0f) * paula->audio.masterVol;
 }
 
 /* The following routines are only safe to call from the mixer thread,
 ** or from another thread if the DMAs are stopped first.
 */
 
-void paulaSetPeriod(int32_t ch, uint16_t period)
+// 8bb: returns false if the write is to be applied at once (not queueing, or the queue is full)
+static bool queueEvent(paula_t *paula, int32_t type, int32_t ch, uint16_t value, const int8_t *src, int8_t *dst)
 {
-	paulaVoice_t *v = &paula[ch];
+	paulaEventQueue_t *q = &paula->events;
+	if (!q->queueing || q->numEvents >= PAULA_EVENT_QUEUE_LEN)
+		return false;
+
+	paulaEvent_t *e = &q->event[q->numEvents++];
+	e->offset = q->offset;
+	e->type = (uint8_t)type;
+	e->ch = (uint8_t)ch;
+	e->value = value;
+	e->src = src;
+	e->dst = dst;
+
+	return true;
+}
+
+void paulaSetPeriod(paula_t *paula, int32_t ch, uint16_t period)
+{
+	if (queueEvent(paula, PAULA_EVENT_PERIOD, ch, period, NULL, NULL))
+		return;
+
+	paulaVoice_t *v = &paula->voice[ch];
 
 	int32_t realPeriod = period;
 	if (realPeriod == 0)
@@ -198,54 +337,71 @@ void paulaSetPeriod(int32_t ch, uint16_t period)
 		realPeriod = 113; // close to what happens on real Amiga (and low-limit needed for BLEP synthesis)
 
 	// to be read on next sampling step (or on DMA trigger)
-	v->fStoredDelta = fPeriodToDeltaDiv / (float)realPeriod;
+	v->fStoredDelta = paula->fPeriodToDeltaDiv / (float)realPeriod;
+	v->storedDelta = (uint32_t)(((uint64_t)(AMIGA_PAL_XTAL_HZ / 8) << 32) / ((uint64_t)paula->audio.outputFreq * realPeriod));
 
 	// BLEP synthesis edge-case
 	if (v->fBlepDelta == 0.0f)
 		v->fBlepDelta = v->fDelta;
+
+	if (v->blepDelta == 0)
+		v->blepDelta = v->delta;
 }
 
-void paulaSetVolume(int32_t ch, uint16_t vol)
+void paulaSetVolume(paula_t *paula, int32_t ch, uint16_t vol)
 {
+	if (queueEvent(paula, PAULA_EVENT_VOLUME, ch, vol, NULL, NULL))
+		return;
+
 	int32_t realVol = vol & 127;
 	if (realVol > 64)
 		realVol = 64;
 
 	// multiplying sample point by this also scales the sample from -128..127 -> -1.000 .. ~0.992
-	paula[ch].fStoredVol = realVol * (1.0f / (128.0f * 64.0f));
+	paula->voice[ch].fStoredVol = realVol * (1.0f / (128.0f * 64.0f));
+	paula->voice[ch].storedVol = realVol;
 }
 
-void paulaSetLength(int32_t ch, uint16_t len)
+void paulaSetLength(paula_t *paula, int32_t ch, uint16_t len)
 {
+	if (queueEvent(paula, PAULA_EVENT_LENGTH, ch, len, NULL, NULL))
+		return;
+
 	// since AHX has a fixed Paula buffer size, clamp it here
 	if (len == 0 || len > MAX_SAMPLE_LENGTH)
 		len = MAX_SAMPLE_LENGTH;
 		
-	paula[ch].storedLength = len;
+	paula->voice[ch].storedLength = len;
 }
 
-void paulaSetData(int32_t ch, const int8_t *src)
+void paulaSetData(paula_t *paula, int32_t ch, const int8_t *src)
 {
+	if (queueEvent(paula, PAULA_EVENT_DATA, ch, 0, src, NULL))
+		return;
+
 	if (src == NULL)
 		src = nullSample;
 
-	paula[ch].storedLocation = src;
+	paula->voice[ch].storedLocation = src;
 }
 
 static inline void refetchPeriod(paulaVoice_t *v) // Paula stage
 {
 	v->fBlepPhase = v->fPhase;
 	v->fBlepDelta = v->fDelta;
+	v->blepPhase = v->phase;
+	v->blepDelta = v->delta;
 
 	// Paula only updates period (delta) during period refetching (this stage)
 	v->fDelta = v->fStoredDelta;
+	v->delta = v->storedDelta;
 
 	v->nextSampleStage = true;
 }
 
-static void startPaulaDMA(int32_t ch)
+static void startPaulaDMA(paula_t *paula, int32_t ch)
 {
-	paulaVoice_t *v = &paula[ch];
+	paulaVoice_t *v = &paula->voice[ch];
 
 	if (v->storedLocation == NULL)
 		v->storedLocation = nullSample;
@@ -261,36 +417,87 @@ static void startPaulaDMA(int32_t ch)
 
 	// kludge: must be cleared *after* refetchPeriod()
 	v->fPhase = 0.0f;
+	v->phase = 0;
 
 	v->active = true;
 }
 
-static void stopPaulaDMA(int32_t ch)
+static void stopPaulaDMA(paula_t *paula, int32_t ch)
 {
-	paula[ch].active = false;
+	paula->voice[ch].active = false;
 }
 
-void paulaSetDMACON(uint16_t bits) // $DFF096 register write (only controls paula DMAs)
+void paulaSetDMACON(paula_t *paula, uint16_t bits) // $DFF096 register write (only controls paula DMAs)
 {
+	if (queueEvent(paula, PAULA_EVENT_DMACON, 0, bits, NULL, NULL))
+		return;
+
 	if (bits & 0x8000)
 	{
 		// set
-		if (bits & 1) startPaulaDMA(0);
-		if (bits & 2) startPaulaDMA(1);
-		if (bits & 4) startPaulaDMA(2);
-		if (bits & 8) startPaulaDMA(3);
+		if (bits & 1) startPaulaDMA(paula, 0);
+		if (bits & 2) startPaulaDMA(paula, 1);
+		if (bits & 4) startPaulaDMA(paula, 2);
+		if (bits & 8) startPaulaDMA(paula, 3);
 	}
 	else
 	{
 		// clear
-		if (bits & 1) stopPaulaDMA(0);
-		if (bits & 2) stopPaulaDMA(1);
-		if (bits & 4) stopPaulaDMA(2);
-		if (bits & 8) stopPaulaDMA(3);
+		if (bits & 1) stopPaulaDMA(paula, 0);
+		if (bits & 2) stopPaulaDMA(paula, 1);
+		if (bits & 4) stopPaulaDMA(paula, 2);
+		if (bits & 8) stopPaulaDMA(paula, 3);
+	}
+}
+
+void paulaQueueEvents(paula_t *paula)
+{
+	paula->events.queueing = (paula->events.event != NULL);
+	paula->events.offset = 0;
+}
+
+void paulaSetEventOffset(paula_t *paula, uint32_t offset)
+{
+	paula->events.offset = offset;
+}
+
+bool paulaEventQueueHasRoom(const paula_t *paula)
+{
+	const paulaEventQueue_t *q = &paula->events;
+
+	// 8bb: a replayer tick writes DMACON once and period/volume/length/data/waveform at most once per voice
+	return q->numEvents+(1+(PAULA_VOICES*5)) <= PAULA_EVENT_QUEUE_LEN && q->numWaveforms+PAULA_VOICES <= PAULA_EVENT_WAVEFORMS;
+}
+
+int8_t *paulaGetDataWriteBuffer(paula_t *paula, int8_t *dst)
+{
+	paulaEventQueue_t *q = &paula->events;
+	if (!q->queueing || q->numWaveforms >= PAULA_EVENT_WAVEFORMS)
+		return dst; // 8bb: write it directly
+
+	int8_t *staged = &q->waveform[q->numWaveforms * (MAX_SAMPLE_LENGTH*2)];
+	if (!queueEvent(paula, PAULA_EVENT_WAVEFORM, 0, 0, staged, dst))
+		return dst;
+
+	q->numWaveforms++;
+	return staged;
+}
+
+static void applyEvent(paula_t *paula, const paulaEvent_t *e)
+{
+	switch (e->type)
+	{
+		case PAULA_EVENT_DMACON: paulaSetDMACON(paula, e->value); break;
+		case PAULA_EVENT_PERIOD: paulaSetPeriod(paula, e->ch, e->value); break;
+		case PAULA_EVENT_VOLUME: paulaSetVolume(paula, e->ch, e->value); break;
+		case PAULA_EVENT_LENGTH: paulaSetLength(paula, e->ch, e->value); break;
+		case PAULA_EVENT_DATA: paulaSetData(paula, e->ch, e->src); break;
+		case PAULA_EVENT_WAVEFORM: memcpy(e->dst, e->src, MAX_SAMPLE_LENGTH*2); break;
+		default: break;
 	}
 }
 
-static inline void nextSample(paulaVoice_t *v, blep_t *b)
+static inline int8_t fetchSample(paulaVoice_t *v) // 8bb: returns the current sample point, and progresses AUD_DAT
 {
 	if (v->sampleCounter == 0)
 	{
@@ -314,72 +521,141 @@ static inline void nextSample(paulaVoice_t *v, blep_t *b)
 		v->sampleCounter = 2;
 	}
 
+	const int8_t smp = v->AUD_DAT[0];
+
+	// progress AUD_DAT buffer
+	v->AUD_DAT[0] = v->AUD_DAT[1];
+	v->sampleCounter--;
+
+	return smp;
+}
+
+/* 8bb: A voice that is DMA-active with volume 0 (f.ex. after ahxQuietAudios()), and that has no
+** BLEP left, adds nothing to the mix. It's only stepped through the block then, so that it's in sync
+** when the volume goes up again. This uses the same float operations as the mixer loops (the phase
+** is built up per sample), so the output is bit-exact with mixing the voice, for any block size.
+*/
+static inline bool voiceIsSilent(const paulaVoice_t *v, const blep_t *b)
+{
+	return v->fStoredVol == 0.0f && v->fSample == 0.0f && b->fLastValue == 0.0f && b->samplesLeft == 0;
+}
+
+static void advanceSilentVoice(paulaVoice_t *v, int32_t numSamples)
+{
+	for (int32_t i = 0; i < numSamples; i++)
+	{
+		if (v->nextSampleStage)
+		{
+			v->nextSampleStage = false;
+			v->fSample = fetchSample(v) * v->fStoredVol; // 8bb: stays 0.0f, so nextSample() wouldn't add a BLEP
+		}
+
+		v->fPhase += v->fDelta;
+		if (v->fPhase >= 1.0f)
+		{
+			v->fPhase -= 1.0f;
+			refetchPeriod(v);
+		}
+	}
+}
+
+static inline void nextSample(paulaVoice_t *v, blep_t *b, const blepTaps_t *t, const int32_t blepLength)
+{
 	/* Pre-compute current sample point.
 	** Output volume is only read from AUDxVOL at this stage,
 	** and we don't emulate volume PWM anyway, so we can
 	** pre-multiply by volume here.
 	*/
-	v->fSample = v->AUD_DAT[0] * v->fStoredVol; // -128..127 * 0.0f .. 1.0f
+	v->fSample = fetchSample(v) * v->fStoredVol; // -128..127 * 0.0f .. 1.0f
 
 	// fill BLEP buffer if the new sample differs from the old one
 	if (v->fSample != b->fLastValue)
 	{
-		if (v->fBlepDelta > v->fBlepPhase) // also checks if v->fBlepDelta > 0.0f
+		if (blepLength > 0 && v->fBlepDelta > v->fBlepPhase) // also checks if v->fBlepDelta > 0.0f
 		{
 			const float fBlepOffset = v->fBlepPhase / v->fBlepDelta;
-			blepAdd(b, fBlepOffset, b->fLastValue - v->fSample);
+			blepAdd(b, t, blepLength, fBlepOffset, b->fLastValue - v->fSample);
 		}
 
 		b->fLastValue = v->fSample;
 	}
-
-	// progress AUD_DAT buffer
-	v->AUD_DAT[0] = v->AUD_DAT[1];
-	v->sampleCounter--;
 }
 
-static void paulaGenerateSamples(float *fOutL, float *fOutR, int32_t numSamples)
+// 8bb: stems renders every voice into its own buffer (fVoiceOut[0..3]) instead, fOutL/fOutR are then not used
+static FORCE_INLINE void generateSamples(paula_t *paula, float *fOutL, float *fOutR, float *const *fVoiceOut, int32_t numSamples,
+	const blepTaps_t *t, const int32_t blepLength, const bool mono, const bool stems)
 {
 	float *fMixBufSelect[PAULA_VOICES];
 
 	if (numSamples <= 0)
 		return;
 
-	fMixBufSelect[0] = fOutL;
-	fMixBufSelect[1] = fOutR;
-	fMixBufSelect[2] = fOutR;
-	fMixBufSelect[3] = fOutL;
-
-	// clear mix buffer block
-	memset(fOutL, 0, numSamples * sizeof (float));
-	memset(fOutR, 0, numSamples * sizeof (float));
+	if (stems)
+	{
+		for (int32_t i = 0; i < PAULA_VOICES; i++)
+		{
+			fMixBufSelect[i] = fVoiceOut[i];
+			memset(fVoiceOut[i], 0, numSamples * sizeof (float));
+		}
+	}
+	else
+	{
+		fMixBufSelect[0] = fOutL;
+		fMixBufSelect[1] = mono ? fOutL : fOutR;
+		fMixBufSelect[2] = mono ? fOutL : fOutR;
+		fMixBufSelect[3] = fOutL;
+
+		// clear mix buffer block
+		memset(fOutL, 0, numSamples * sizeof (float));
+		if (!mono)
+			memset(fOutR, 0, numSamples * sizeof (float));
+	}
 
 	// mix samples
 
-	paulaVoice_t *v = paula;
-	blep_t *b = blep;
+	const int32_t disabledVoices = paula->audio.disabledVoices; // 8bb: not mixed or advanced (see paulaSetVoiceMask())
+	paulaVoice_t *v = paula->voice;
+	blep_t *b = paula->blep;
 
 	for (int32_t i = 0; i < PAULA_VOICES; i++, v++, b++)
 	{
-		if (!v->active || v->location == NULL || v->storedLocation == NULL)
+		if (!v->active || v->location == NULL || v->storedLocation == NULL || (disabledVoices & (1 << i)))
 			continue;
 
-		float *fMixBuffer = fMixBufSelect[i]; // what output channel to mix into (L, R, R, L)
-		for (int32_t j = 0; j < numSamples; j++)
+		if (voiceIsSilent(v, b))
+		{
+			advanceSilentVoice(v, numSamples);
+			continue;
+		}
+
+		float *fMixBuffer = fMixBufSelect[i]; // what output channel to mix into (L, R, R, L, all in L for mono, or the voice's own)
+		for (int32_t j = 0; j < numSamples;)
 		{
 			if (v->nextSampleStage)
 			{
 				v->nextSampleStage = false;
-				nextSample(v, b); // inlined
+				nextSample(v, b, t, blepLength); // inlined
 			}
 
-			float fSample = v->fSample; // current sample, pre-multiplied by vol, scaled to -1.0 .. 0.992
-			if (b->samplesLeft > 0)
-				fSample = blepRun(b, fSample);
+			/* 8bb: The voice outputs a constant sample point until the next sampling step,
+			** so find that point first, then mix the whole span at once.
+			*/
+			int32_t spanEnd = j;
+			do
+			{
+				v->fPhase += v->fDelta;
+				spanEnd++;
+			}
+			while (v->fPhase < 1.0f && spanEnd < numSamples);
+
+			const float fSample = v->fSample; // current sample, pre-multiplied by vol, scaled to -1.0 .. 0.992
+
+			for (; j < spanEnd && b->samplesLeft > 0; j++) // pending BLEP tail
+				fMixBuffer[j] += blepRun(b, fSample);
 
-			fMixBuffer[j] += fSample;
+			for (; j < spanEnd; j++)
+				fMixBuffer[j] += fSample;
 
-			v->fPhase += v->fDelta;
 			if (v->fPhase >= 1.0f)
 			{
 				v->fPhase -= 1.0f;
@@ -389,227 +665,2193 @@ static void paulaGenerateSamples(float *fOutL, float *fOutR, int32_t numSamples)
 	}
 }
 
-void resetAudioDithering(void)
-{
-	randSeed = INITIAL_DITHER_SEED;
-	fPrngStateL = 0.0f;
-	fPrngStateR = 0.0f;
-}
-
-static inline int32_t random32(void)
-{
-	// LCG 32-bit random
-	randSeed *= 134775813;
-	randSeed++;
-
-	return (int32_t)randSeed;
-}
-
-static inline void processMixedSamplesAmigaPanning(uint32_t i, int16_t *out)
-{
-	int32_t out32;
-	float fOut, fPrng;
-
-	float fL = fMixBufferL[i];
-	float fR = fMixBufferR[i];
-
-	// normalize
-	fL *= fMixNormalize;
-	fR *= fMixNormalize;
-
-	// left channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fL + fPrng) - fPrngStateL;
-	fPrngStateL = fPrng;
-	out32 = (int32_t)fOut;
-	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+#ifdef PAULA_SSE2
 
-	// right channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fR + fPrng) - fPrngStateR;
-	fPrngStateR = fPrng;
-	out32 = (int32_t)fOut;
-	out[1] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
-}
+/* 8bb:
+** SIMD mixer. The mixer state of the four voices is copied into a structure-of-arrays
+** (one voice per SSE lane) for every block, so the phase, period refetch, BLEP and mixing
+** are done for all voices at once. DMA fetches and BLEP insertion are done per lane (masked)
+** in a slow path, which is only entered on samples where a voice passed a sampling step.
+**
+** Between sampling steps the mixer works on whole spans (see below). BLEP is run for all
+** lanes while any voice has BLEP samples left. That gives the same result as running it per
+** voice, because all entries outside of the active BLEP window are zero. To let all
+** lanes share one BLEP index, the buffers are copied so that each voice's index is 0 at
+** the start of the block.
+**
+** L is (voice 0 + voice 3) and R is (voice 1 + voice 2), added in that order, so
+** this is bit-exact with the plain C mixer.
+*/
 
-static inline void processMixedSamples(uint32_t i, int16_t *out)
+typedef struct mixLanes_t // 8bb: BLEP state of the four voices, index = voice
 {
-	int32_t out32;
-	float fOut, fPrng;
-
-	float fL = fMixBufferL[i];
-	float fR = fMixBufferR[i];
-
-	// apply stereo separation
-	const float fOldL = fL;
-	const float fOldR = fR;
-	float fMid  = (fOldL + fOldR) * STEREO_NORM_FACTOR;
-	float fSide = (fOldL - fOldR) * fSideFactor;
-	fL = fMid + fSide;
-	fR = fMid - fSide;
-
-	// normalize
-	fL *= fMixNormalize;
-	fR *= fMixNormalize;
-
-	// left channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fL + fPrng) - fPrngStateL;
-	fPrngStateL = fPrng;
-	out32 = (int32_t)fOut;
-	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
-
-	// right channel - 1-bit triangular dithering
-	fPrng = (float)random32() * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
-	fOut = (fR + fPrng) - fPrngStateR;
-	fPrngStateR = fPrng;
-	out32 = (int32_t)fOut;
-	out[1] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
-}
+	float fBlepBuffer[PAULA_VOICES][(BLEP_RNS+1)*2]; // 8bb: linear windows like blep_t, all at the same index
+	int32_t blepPos; // 8bb: sample position of index 0 in the windows
+	int32_t blepEnd[PAULA_VOICES]; // 8bb: sample position where the BLEP runs out (for blep_t.samplesLeft)
+	int32_t blepEndMax; // 8bb: ...and for all voices
+} mixLanes_t;
 
-void paulaMixSamples(int16_t *target, uint32_t numSamples)
+static inline __m128 laneMask(int32_t bits) // 8bb: bit i -> all ones in lane i
 {
-	// normalize, adjust stereo separation (if needed), dither and quantize
-	
-	paulaGenerateSamples(fMixBufferL, fMixBufferR, numSamples);
-
-	int16_t out[2];
-	int16_t *outStream = target;
-	if (audio.stereoSeparation == 100)
-	{
-		for (uint32_t i = 0; i < numSamples; i++)
-		{
-			processMixedSamplesAmigaPanning(i, out);
-			*outStream++ = out[0];
-			*outStream++ = out[1];
-		}
-	}
-	else
-	{
-		for (uint32_t i = 0; i < numSamples; i++)
-		{
-			processMixedSamples(i, out);
-			*outStream++ = out[0];
-			*outStream++ = out[1];
-		}
-	}
+	return _mm_castsi128_ps(_mm_set_epi32(-((bits >> 3) & 1), -((bits >> 2) & 1), -((bits >> 1) & 1), -(bits & 1)));
 }
 
-void paulaTogglePause(void)
+static inline __m128 laneSelect(__m128 vMask, __m128 a, __m128 b) // 8bb: (vMask ? a : b)
 {
-	audio.pause ^= 1;
+	return _mm_or_ps(_mm_and_ps(vMask, a), _mm_andnot_ps(vMask, b));
 }
 
-void paulaOutputSamples(int16_t *stream, int32_t numSamples)
+static inline void slideBlepWindows(mixLanes_t *m, int32_t pos) // 8bb: makes pos an index in the first half
 {
-	int16_t *streamOut = (int16_t *)stream;
+	if (pos-m->blepPos <= BLEP_RNS)
+		return;
 
-	if (audio.pause)
+	if (pos >= m->blepEndMax) // 8bb: no BLEP pending, just clear the windows
 	{
-		memset(stream, 0, numSamples * 2 * sizeof (int16_t));
+		memset(m->fBlepBuffer, 0, sizeof (m->fBlepBuffer));
+		m->blepPos = pos;
 		return;
 	}
 
-	int32_t samplesLeft = numSamples;
-	while (samplesLeft > 0)
+	while (pos-m->blepPos > BLEP_RNS)
 	{
-		if (audio.tickSampleCounter <= 0) // new replayer tick
+		for (int32_t i = 0; i < PAULA_VOICES; i++)
 		{
-			tickReplayer();
-			audio.tickSampleCounter = audio.samplesPerTickInt;
-
-			audio.tickSampleCounterFrac += audio.samplesPerTickFrac;
-			if (audio.tickSampleCounterFrac >= BPM_FRAC_SCALE)
-			{
-				audio.tickSampleCounterFrac &= BPM_FRAC_MASK;
-				audio.tickSampleCounter++;
-			}
+			float *fBuffer = m->fBlepBuffer[i];
+			memcpy(&fBuffer[0], &fBuffer[BLEP_RNS+1], BLEP_NS * sizeof (float));
+			memset(&fBuffer[BLEP_NS], 0, (BLEP_RNS+1) * sizeof (float)); // 8bb: the used part, and the second half
 		}
 
-		int32_t samplesToMix = samplesLeft;
-		if (audio.tickSampleCounter > 0 && samplesToMix > audio.tickSampleCounter)
-			samplesToMix = audio.tickSampleCounter;
+		m->blepPos += BLEP_RNS+1;
+	}
+}
 
-		paulaMixSamples(streamOut, samplesToMix);
-		streamOut += samplesToMix * 2; // *2 for stereo
+// 8bb: fBuffer[n] += fAmplitude * (fTap[n] + (fSlope[n] * f)), the same math as blepAdd()
+static inline void blepAddTapsSSE2(float *fBuffer, const float *fTap, const float *fSlope, const int32_t blepLength,
+	const float f, const float fAmplitude)
+{
+	const __m128 vFrac = _mm_set1_ps(f);
+	const __m128 vAmplitude = _mm_set1_ps(fAmplitude);
 
-		samplesLeft -= samplesToMix;
-		audio.tickSampleCounter -= samplesToMix;
+	for (int32_t n = 0; n < blepLength; n += 4)
+	{
+		const __m128 vTap = _mm_add_ps(_mm_loadu_ps(&fTap[n]), _mm_mul_ps(_mm_loadu_ps(&fSlope[n]), vFrac));
+		_mm_storeu_ps(&fBuffer[n], _mm_add_ps(_mm_loadu_ps(&fBuffer[n]), _mm_mul_ps(vAmplitude, vTap)));
 	}
 }
 
-void paulaSetStereoSeparation(int32_t percentage) // 0..100 (percentage)
+#ifdef PAULA_AVX
+static TARGET_AVX2 void blepAddTapsAVX2(float *fBuffer, const float *fTap, const float *fSlope, const int32_t blepLength,
+	const float f, const float fAmplitude)
 {
-	audio.stereoSeparation = CLAMP(percentage, 0, 100);
-	fSideFactor = (audio.stereoSeparation / 100.0f) * STEREO_NORM_FACTOR;
+	const __m256 vFrac = _mm256_set1_ps(f);
+	const __m256 vAmplitude = _mm256_set1_ps(fAmplitude);
+
+	for (int32_t n = 0; n < blepLength; n += 8)
+	{
+		const __m256 vTap = _mm256_add_ps(_mm256_loadu_ps(&fTap[n]), _mm256_mul_ps(_mm256_loadu_ps(&fSlope[n]), vFrac));
+		_mm256_storeu_ps(&fBuffer[n], _mm256_add_ps(_mm256_loadu_ps(&fBuffer[n]), _mm256_mul_ps(vAmplitude, vTap)));
+	}
 }
 
-double amigaCIAPeriod2Hz(uint16_t period)
+static TARGET_AVX512 void blepAddTapsAVX512(float *fBuffer, const float *fTap, const float *fSlope, const int32_t blepLength,
+	const float f, const float fAmplitude)
 {
-	if (period == 0)
-		return 0.0;
+	const __m512 vFrac = _mm512_set1_ps(f);
+	const __m512 vAmplitude = _mm512_set1_ps(fAmplitude);
+	const __mmask16 k = (__mmask16)((blepLength >= 16) ? 0xFFFF : ((1 << blepLength) - 1)); // 8bb: BLEP_NS is 16
 
-	return (double)CIA_PAL_CLK / (period+1); // +1, CIA triggers on underflow
+	const __m512 vTap = _mm512_add_ps(_mm512_maskz_loadu_ps(k, fTap), _mm512_mul_ps(_mm512_maskz_loadu_ps(k, fSlope), vFrac));
+	_mm512_mask_storeu_ps(fBuffer, k, _mm512_add_ps(_mm512_maskz_loadu_ps(k, fBuffer), _mm512_mul_ps(vAmplitude, vTap)));
 }
+#endif
 
-bool amigaSetCIAPeriod(uint16_t period)
+static inline void blepAddLane(mixLanes_t *m, const blepTaps_t *t, const int32_t blepLength, const int32_t simd,
+	int32_t ch, int32_t pos, const float fOffset, const float fAmplitude)
 {
-	const double dCIAHz = amigaCIAPeriod2Hz(period);
-	if (dCIAHz == 0.0)
-		return false;
+	float f = fOffset * BLEP_SP;
 
-	const double dSamplesPerTick = audio.outputFreq / dCIAHz;
+	const int32_t fInt = (int32_t)f; // get integer part of f
+	const float *fTap = t->fTap[fInt];
+	const float *fSlope = t->fSlope[fInt];
+	f -= fInt; // remove integer part from f
 
-	double dSamplesPerTickInt, dSamplesPerTickFrac = modf(dSamplesPerTick, &dSamplesPerTickInt);
+	float *fBuffer = &m->fBlepBuffer[ch][pos-m->blepPos];
+#ifdef PAULA_AVX
+	if (simd == PAULA_SIMD_AVX512)
+		blepAddTapsAVX512(fBuffer, fTap, fSlope, blepLength, f, fAmplitude);
+	else if (simd == PAULA_SIMD_AVX2)
+		blepAddTapsAVX2(fBuffer, fTap, fSlope, blepLength, f, fAmplitude);
+	else
+#endif
+		blepAddTapsSSE2(fBuffer, fTap, fSlope, blepLength, f, fAmplitude);
 
-	audio.samplesPerTickInt = (uint32_t)dSamplesPerTickInt;
-	audio.samplesPerTickFrac = (uint64_t)(dSamplesPerTickFrac * BPM_FRAC_SCALE);
+#ifndef PAULA_AVX
+	(void)simd;
+#endif
 
-	return true;
+	m->blepEnd[ch] = pos + blepLength;
+	m->blepEndMax = pos + blepLength; // 8bb: pos only increases
 }
 
-bool paulaInit(int32_t audioFrequency)
+// 8bb: all four lanes summed in voice order, like the plain C mixer does in mono
+static inline __m128 mixMono(__m128 vOut)
 {
-	const int32_t minFreq = (int32_t)(PAULA_PAL_CLK / 113.0)+1; // mixer requires single-step deltas
-	audio.outputFreq = CLAMP(audioFrequency, minFreq, 384000);
-
-	// set defaults
-	paulaSetStereoSeparation(20);
-	paulaSetMasterVolume(256);
+	__m128 vMix = _mm_add_ss(vOut, _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(1, 1, 1, 1)));
+	vMix = _mm_add_ss(vMix, _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(2, 2, 2, 2)));
+	return _mm_add_ss(vMix, _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(3, 3, 3, 3)));
+}
 
-	fPeriodToDeltaDiv = (float)((double)PAULA_PAL_CLK / audio.outputFreq);
+// 8bb: stems stores the lanes in one buffer per voice (fVoiceOut[0..3]), see generateSamples()
+static FORCE_INLINE void generateSamplesSSE2(paula_t *paula, float *fOutL, float *fOutR, float *const *fVoiceOut, int32_t numSamples,
+	const blepTaps_t *t, const int32_t blepLength, const int32_t simd, const bool mono, const bool stems)
+{
+	mixLanes_t m;
+	float fTmp[2][PAULA_VOICES], fPhase[PAULA_VOICES], fDelta[PAULA_VOICES], fSample[PAULA_VOICES];
+	float fBlepPhase[PAULA_VOICES], fBlepDelta[PAULA_VOICES], fLastValue[PAULA_VOICES];
+	float fStoredDelta[PAULA_VOICES], fStoredVol[PAULA_VOICES];
+	int32_t activeMask = 0, nextSampleMask = 0;
 
-	int32_t maxSamplesToMix = (int32_t)ceil(audio.outputFreq / amigaCIAPeriod2Hz(AHX_HIGHEST_CIA_PERIOD));
+	if (numSamples <= 0)
+		return;
 
-	fMixBufferL = (float *)malloc(maxSamplesToMix * sizeof (float));
-	fMixBufferR = (float *)malloc(maxSamplesToMix * sizeof (float));
+	// 8bb: inactive voices stay silent (0.0f) in their lane, and are not written back
+	memset(&m, 0, sizeof (m));
+	memset(fPhase, 0, sizeof (fPhase));
+	memset(fDelta, 0, sizeof (fDelta));
+	memset(fSample, 0, sizeof (fSample));
+	memset(fBlepPhase, 0, sizeof (fBlepPhase));
+	memset(fBlepDelta, 0, sizeof (fBlepDelta));
+	memset(fLastValue, 0, sizeof (fLastValue));
+	memset(fStoredDelta, 0, sizeof (fStoredDelta));
+	memset(fStoredVol, 0, sizeof (fStoredVol));
+
+	const int32_t disabledVoices = paula->audio.disabledVoices;
+	paulaVoice_t *v = paula->voice;
+	blep_t *b = paula->blep;
 
-	if (fMixBufferL == NULL || fMixBufferR == NULL)
+	for (int32_t i = 0; i < PAULA_VOICES; i++, v++, b++)
 	{
-		paulaClose();
-		return false;
-	}
+		if (!v->active || v->location == NULL || v->storedLocation == NULL || (disabledVoices & (1 << i)))
+			continue;
 
-	amigaSetCIAPeriod(AHX_DEFAULT_CIA_PERIOD);
+		if (voiceIsSilent(v, b)) // 8bb: keep it out of the lanes, so that it doesn't split the spans
+		{
+			advanceSilentVoice(v, numSamples);
+			continue;
+		}
 
-	audio.tickSampleCounter = 0; // zero tick sample counter so that it will instantly initiate a tick
-	audio.samplesPerTickFrac = 0;
+		activeMask |= 1 << i;
+		if (v->nextSampleStage)
+			nextSampleMask |= 1 << i;
 
-	resetAudioDithering();
-	return true;
-}
+		fPhase[i] = v->fPhase;
+		fDelta[i] = v->fDelta;
+		fSample[i] = v->fSample;
+		fBlepPhase[i] = v->fBlepPhase;
+		fBlepDelta[i] = v->fBlepDelta;
+		fStoredDelta[i] = v->fStoredDelta; // 8bb: Paula registers are only written between blocks
+		fStoredVol[i] = v->fStoredVol;
+		fLastValue[i] = b->fLastValue;
 
-void paulaClose(void)
-{
-	if (fMixBufferL != NULL)
-	{
-		free(fMixBufferL);
-		fMixBufferL = NULL;
+		m.blepEnd[i] = b->samplesLeft;
+		if (m.blepEnd[i] > m.blepEndMax)
+			m.blepEndMax = m.blepEnd[i];
+
+		memcpy(m.fBlepBuffer[i], &b->fBuffer[b->index], (((BLEP_RNS+1)*2) - b->index) * sizeof (float));
 	}
 
-	if (fMixBufferR != NULL)
+	if (activeMask == 0)
 	{
-		free(fMixBufferR);
-		fMixBufferR = NULL;
+		if (stems)
+		{
+			for (int32_t i = 0; i < PAULA_VOICES; i++)
+				memset(fVoiceOut[i], 0, numSamples * sizeof (float));
+		}
+		else
+		{
+			memset(fOutL, 0, numSamples * sizeof (float));
+			if (!mono)
+				memset(fOutR, 0, numSamples * sizeof (float));
+		}
+
+		return;
 	}
+
+	const __m128 vActive = laneMask(activeMask);
+	const __m128 vOne = _mm_set1_ps(1.0f);
+	const __m128 vStoredDelta = _mm_loadu_ps(fStoredDelta);
+	const __m128 vStoredVol = _mm_loadu_ps(fStoredVol);
+
+	__m128 vPhase = _mm_loadu_ps(fPhase);
+	__m128 vDelta = _mm_loadu_ps(fDelta);
+	__m128 vSample = _mm_loadu_ps(fSample);
+	__m128 vBlepPhase = _mm_loadu_ps(fBlepPhase);
+	__m128 vBlepDelta = _mm_loadu_ps(fBlepDelta);
+	__m128 vLastValue = _mm_loadu_ps(fLastValue);
+	__m128 vNextSample = laneMask(nextSampleMask);
+
+	for (int32_t j = 0; j < numSamples;)
+	{
+		if (nextSampleMask != 0) // 8bb: slow path, fetch new sample points (see nextSample() in the plain C mixer)
+		{
+			paulaVoice_t *vc = paula->voice;
+			const __m128i vSmp = _mm_setr_epi32(
+				(nextSampleMask & 1) ? fetchSample(&vc[0]) : 0,
+				(nextSampleMask & 2) ? fetchSample(&vc[1]) : 0,
+				(nextSampleMask & 4) ? fetchSample(&vc[2]) : 0,
+				(nextSampleMask & 8) ? fetchSample(&vc[3]) : 0);
+
+			// -128..127 * 0.0f .. 1.0f
+			vSample = laneSelect(vNextSample, _mm_mul_ps(_mm_cvtepi32_ps(vSmp), vStoredVol), vSample);
+
+			// fill BLEP buffer if the new sample differs from the old one
+			const __m128 vChanged = _mm_and_ps(_mm_cmpneq_ps(vSample, vLastValue), vNextSample);
+			const int32_t changedMask = _mm_movemask_ps(vChanged);
+			if (changedMask != 0)
+			{
+				const int32_t blepMask = _mm_movemask_ps(_mm_cmpgt_ps(vBlepDelta, vBlepPhase)) & changedMask;
+				if (blepLength > 0 && blepMask != 0)
+				{
+					slideBlepWindows(&m, j);
+
+					_mm_storeu_ps(fTmp[0], _mm_div_ps(vBlepPhase, vBlepDelta)); // BLEP offset
+					_mm_storeu_ps(fTmp[1], _mm_sub_ps(vLastValue, vSample)); // BLEP amplitude
+
+					for (int32_t i = 0; i < PAULA_VOICES; i++)
+					{
+						if (blepMask & (1 << i))
+							blepAddLane(&m, t, blepLength, simd, i, j, fTmp[0][i], fTmp[1][i]);
+					}
+				}
+
+				vLastValue = laneSelect(vChanged, vSample, vLastValue);
+			}
+		}
+
+		/* 8bb: All voices output a constant sample point until the next sampling step of any voice,
+		** so find that point first. Only the pending BLEP tail has to be run for the span.
+		*/
+		int32_t spanEnd = j;
+		do
+		{
+			vPhase = _mm_add_ps(vPhase, vDelta); // 8bb: inactive voices have a delta of zero
+			vNextSample = _mm_and_ps(_mm_cmpge_ps(vPhase, vOne), vActive);
+			nextSampleMask = _mm_movemask_ps(vNextSample);
+			spanEnd++;
+		}
+		while (nextSampleMask == 0 && spanEnd < numSamples);
+
+		const int32_t blepEnd = (m.blepEndMax < spanEnd) ? m.blepEndMax : spanEnd;
+		for (; j < blepEnd; j++)
+		{
+			slideBlepWindows(&m, j);
+
+			// run BLEP (current sample points are pre-multiplied by vol, scaled to -1.0 .. 0.992)
+			const int32_t r = j - m.blepPos;
+			const __m128 vBlep = _mm_setr_ps(m.fBlepBuffer[0][r], m.fBlepBuffer[1][r], m.fBlepBuffer[2][r], m.fBlepBuffer[3][r]);
+			const __m128 vOut = _mm_and_ps(_mm_add_ps(vSample, vBlep), vActive);
+
+			if (stems)
+			{
+				_mm_store_ss(&fVoiceOut[0][j], vOut);
+				_mm_store_ss(&fVoiceOut[1][j], _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(1, 1, 1, 1)));
+				_mm_store_ss(&fVoiceOut[2][j], _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(2, 2, 2, 2)));
+				_mm_store_ss(&fVoiceOut[3][j], _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(3, 3, 3, 3)));
+			}
+			else if (mono)
+			{
+				_mm_store_ss(&fOutL[j], mixMono(vOut));
+			}
+			else
+			{
+				// mix (L = voice 0 + voice 3, R = voice 1 + voice 2)
+				const __m128 vMix = _mm_add_ps(vOut, _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(0, 1, 2, 3)));
+				_mm_store_ss(&fOutL[j], vMix);
+				_mm_store_ss(&fOutR[j], _mm_shuffle_ps(vMix, vMix, _MM_SHUFFLE(1, 1, 1, 1)));
+			}
+		}
+
+		if (stems && j < spanEnd)
+		{
+			_mm_storeu_ps(fTmp[0], _mm_and_ps(vSample, vActive));
+			for (int32_t i = 0; i < PAULA_VOICES; i++)
+			{
+				float *fVoice = fVoiceOut[i];
+				for (int32_t k = j; k < spanEnd; k++)
+					fVoice[k] = fTmp[0][i];
+			}
+
+			j = spanEnd;
+		}
+		else if (mono && j < spanEnd)
+		{
+			const float fMix = _mm_cvtss_f32(mixMono(_mm_and_ps(vSample, vActive)));
+			for (; j < spanEnd; j++)
+				fOutL[j] = fMix;
+		}
+		else if (j < spanEnd) // 8bb: no BLEP left, the mix is constant for the rest of the span
+		{
+			const __m128 vOut = _mm_and_ps(vSample, vActive);
+			const __m128 vMix = _mm_add_ps(vOut, _mm_shuffle_ps(vOut, vOut, _MM_SHUFFLE(0, 1, 2, 3)));
+
+			const float fMixL = _mm_cvtss_f32(vMix);
+			const float fMixR = _mm_cvtss_f32(_mm_shuffle_ps(vMix, vMix, _MM_SHUFFLE(1, 1, 1, 1)));
+
+			for (; j < spanEnd; j++)
+			{
+				fOutL[j] = fMixL;
+				fOutR[j] = fMixR;
+			}
+		}
+
+		if (nextSampleMask != 0) // period refetch for the voices that passed a sampling step (see refetchPeriod())
+		{
+			vPhase = _mm_sub_ps(vPhase, _mm_and_ps(vNextSample, vOne));
+			vBlepPhase = laneSelect(vNextSample, vPhase, vBlepPhase);
+			vBlepDelta = laneSelect(vNextSample, vDelta, vBlepDelta);
+			vDelta = laneSelect(vNextSample, vStoredDelta, vDelta);
+		}
+	}
+
+	_mm_storeu_ps(fPhase, vPhase);
+	_mm_storeu_ps(fDelta, vDelta);
+	_mm_storeu_ps(fSample, vSample);
+	_mm_storeu_ps(fBlepPhase, vBlepPhase);
+	_mm_storeu_ps(fBlepDelta, vBlepDelta);
+	_mm_storeu_ps(fLastValue, vLastValue);
+
+	// 8bb: write the state back (the BLEP buffers get index 0)
+
+	slideBlepWindows(&m, numSamples);
+
+	v = paula->voice;
+	b = paula->blep;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++, v++, b++)
+	{
+		if (!(activeMask & (1 << i)))
+			continue;
+
+		v->fPhase = fPhase[i];
+		v->fDelta = fDelta[i];
+		v->fSample = fSample[i];
+		v->fBlepPhase = fBlepPhase[i];
+		v->fBlepDelta = fBlepDelta[i];
+		v->nextSampleStage = !!(nextSampleMask & (1 << i));
+		b->fLastValue = fLastValue[i];
+
+		const int32_t samplesLeft = m.blepEnd[i] - numSamples;
+		b->samplesLeft = (samplesLeft > 0) ? samplesLeft : 0;
+		b->index = 0;
+
+		const int32_t r = numSamples - m.blepPos;
+		memcpy(b->fBuffer, &m.fBlepBuffer[i][r], (((BLEP_RNS+1)*2) - r) * sizeof (float));
+		memset(&b->fBuffer[((BLEP_RNS+1)*2) - r], 0, r * sizeof (float));
+	}
+}
+#endif
+
+// 8bb: renders the four voices into fVoiceOut[0..3] (stems)
+static void paulaGenerateVoices(paula_t *paula, float *const *fVoiceOut, int32_t numSamples)
+{
+	const int32_t quality = paula->adapt.enabled ? paula->adapt.quality : paula->audio.quality;
+
+#ifdef PAULA_SSE2
+	const int32_t simd = paula->audio.simd;
+	if (simd >= PAULA_SIMD_SSE2)
+	{
+		switch (quality)
+		{
+			default:
+			case PAULA_QUALITY_BLEP:
+				generateSamplesSSE2(paula, NULL, NULL, fVoiceOut, numSamples, &paula->blepTaps, BLEP_NS, simd, false, true);
+				break;
+
+			case PAULA_QUALITY_SHORT_BLEP:
+				generateSamplesSSE2(paula, NULL, NULL, fVoiceOut, numSamples, &paula->blepTapsShort, BLEP_SHORT_NS, simd, false, true);
+				break;
+
+			case PAULA_QUALITY_NO_BLEP:
+				generateSamplesSSE2(paula, NULL, NULL, fVoiceOut, numSamples, NULL, 0, simd, false, true);
+				break;
+		}
+
+		return;
+	}
+#endif
+
+	switch (quality)
+	{
+		default:
+		case PAULA_QUALITY_BLEP:
+			generateSamples(paula, NULL, NULL, fVoiceOut, numSamples, &paula->blepTaps, BLEP_NS, false, true);
+			break;
+
+		case PAULA_QUALITY_SHORT_BLEP:
+			generateSamples(paula, NULL, NULL, fVoiceOut, numSamples, &paula->blepTapsShort, BLEP_SHORT_NS, false, true);
+			break;
+
+		case PAULA_QUALITY_NO_BLEP:
+			generateSamples(paula, NULL, NULL, fVoiceOut, numSamples, NULL, 0, false, true);
+			break;
+	}
+}
+
+/* 8bb: Sums the stems up to the mix, in the same order as the mixers do it (L = voice 0 + voice 3,
+** R = voice 1 + voice 2, mono = voice 0 + 1 + 2 + 3), so the mix is bit-exact with the one from
+** paulaGenerateSamples() without stems. Silent voices are 0.0f in their buffer, which doesn't change a sum.
+*/
+static void mixVoices(float *const *fVoice, float *fOutL, float *fOutR, int32_t numSamples)
+{
+	const float *fV0 = fVoice[0], *fV1 = fVoice[1], *fV2 = fVoice[2], *fV3 = fVoice[3];
+
+	if (fOutR == NULL)
+	{
+		for (int32_t i = 0; i < numSamples; i++)
+			fOutL[i] = ((fV0[i] + fV1[i]) + fV2[i]) + fV3[i];
+	}
+	else
+	{
+		for (int32_t i = 0; i < numSamples; i++)
+		{
+			fOutL[i] = fV0[i] + fV3[i];
+			fOutR[i] = fV1[i] + fV2[i];
+		}
+	}
+}
+
+/* 8bb: fOutR = NULL mixes all four voices into fOutL (mono).
+** fVoiceOut != NULL also leaves every voice in its own buffer (stems), fOutL = NULL then skips the mix (4 channels).
+*/
+static void paulaGenerateSamples(paula_t *paula, float *fOutL, float *fOutR, float *const *fVoiceOut, int32_t numSamples)
+{
+	if (fVoiceOut != NULL)
+	{
+		paulaGenerateVoices(paula, fVoiceOut, numSamples);
+		if (fOutL != NULL)
+			mixVoices(fVoiceOut, fOutL, fOutR, numSamples);
+
+		return;
+	}
+
+	const int32_t quality = paula->adapt.enabled ? paula->adapt.quality : paula->audio.quality;
+	const bool mono = (fOutR == NULL);
+
+#ifdef PAULA_SSE2
+	/* 8bb: The four voices fill one SSE register, so AVX2/AVX-512 only make a difference
+	** in the BLEP insertion here (see blepAddLane()).
+	*/
+	const int32_t simd = paula->audio.simd;
+	if (simd >= PAULA_SIMD_SSE2)
+	{
+		switch (quality)
+		{
+			default:
+			case PAULA_QUALITY_BLEP:
+				if (mono)
+					generateSamplesSSE2(paula, fOutL, NULL, NULL, numSamples, &paula->blepTaps, BLEP_NS, simd, true, false);
+				else
+					generateSamplesSSE2(paula, fOutL, fOutR, NULL, numSamples, &paula->blepTaps, BLEP_NS, simd, false, false);
+				break;
+
+			case PAULA_QUALITY_SHORT_BLEP:
+				if (mono)
+					generateSamplesSSE2(paula, fOutL, NULL, NULL, numSamples, &paula->blepTapsShort, BLEP_SHORT_NS, simd, true, false);
+				else
+					generateSamplesSSE2(paula, fOutL, fOutR, NULL, numSamples, &paula->blepTapsShort, BLEP_SHORT_NS, simd, false, false);
+				break;
+
+			case PAULA_QUALITY_NO_BLEP:
+				if (mono)
+					generateSamplesSSE2(paula, fOutL, NULL, NULL, numSamples, NULL, 0, simd, true, false);
+				else
+					generateSamplesSSE2(paula, fOutL, fOutR, NULL, numSamples, NULL, 0, simd, false, false);
+				break;
+		}
+
+		return;
+	}
+#endif
+
+	// 8bb: one specialized mixer per quality (and channel count), the BLEP length is a constant in each of them
+	switch (quality)
+	{
+		default:
+		case PAULA_QUALITY_BLEP:
+			if (mono)
+				generateSamples(paula, fOutL, NULL, NULL, numSamples, &paula->blepTaps, BLEP_NS, true, false);
+			else
+				generateSamples(paula, fOutL, fOutR, NULL, numSamples, &paula->blepTaps, BLEP_NS, false, false);
+			break;
+
+		case PAULA_QUALITY_SHORT_BLEP:
+			if (mono)
+				generateSamples(paula, fOutL, NULL, NULL, numSamples, &paula->blepTapsShort, BLEP_SHORT_NS, true, false);
+			else
+				generateSamples(paula, fOutL, fOutR, NULL, numSamples, &paula->blepTapsShort, BLEP_SHORT_NS, false, false);
+			break;
+
+		case PAULA_QUALITY_NO_BLEP:
+			if (mono)
+				generateSamples(paula, fOutL, NULL, NULL, numSamples, NULL, 0, true, false);
+			else
+				generateSamples(paula, fOutL, fOutR, NULL, numSamples, NULL, 0, false, false);
+			break;
+	}
+}
+
+void resetAudioDithering(paula_t *paula)
+{
+	paula->randSeed = INITIAL_DITHER_SEED;
+	paula->fPrngStateL = 0.0f;
+	paula->fPrngStateR = 0.0f;
+	paula->prngStateL = 0;
+	paula->prngStateR = 0;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++) // 8bb: stems, one LCG sequence per voice
+	{
+		paula->stemRandSeed[i] = INITIAL_DITHER_SEED ^ (0x9E3779B9 * (uint32_t)(i+1));
+		paula->fStemPrngState[i] = 0.0f;
+		paula->stemPrngState[i] = 0;
+	}
+}
+
+static inline int32_t randomLCG(uint32_t *seed)
+{
+	// LCG 32-bit random
+	*seed *= 134775813;
+	(*seed)++;
+
+	return (int32_t)*seed;
+}
+
+static inline int32_t random32(paula_t *paula)
+{
+	return randomLCG(&paula->randSeed);
+}
+
+static inline void processMixedSamplesAmigaPanning(paula_t *paula, uint32_t i, int16_t *out)
+{
+	int32_t out32;
+	float fOut, fPrng;
+
+	float fL = paula->fMixBufferL[i];
+	float fR = paula->fMixBufferR[i];
+
+	// normalize
+	fL *= paula->fMixNormalize;
+	fR *= paula->fMixNormalize;
+
+	// left channel - 1-bit triangular dithering
+	fPrng = (float)random32(paula) * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
+	fOut = (fL + fPrng) - paula->fPrngStateL;
+	paula->fPrngStateL = fPrng;
+	out32 = (int32_t)fOut;
+	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+
+	// right channel - 1-bit triangular dithering
+	fPrng = (float)random32(paula) * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
+	fOut = (fR + fPrng) - paula->fPrngStateR;
+	paula->fPrngStateR = fPrng;
+	out32 = (int32_t)fOut;
+	out[1] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+}
+
+static inline void processMixedSamples(paula_t *paula, uint32_t i, int16_t *out)
+{
+	int32_t out32;
+	float fOut, fPrng;
+
+	float fL = paula->fMixBufferL[i];
+	float fR = paula->fMixBufferR[i];
+
+	// apply stereo separation
+	const float fOldL = fL;
+	const float fOldR = fR;
+	float fMid  = (fOldL + fOldR) * STEREO_NORM_FACTOR;
+	float fSide = (fOldL - fOldR) * paula->fSideFactor;
+	fL = fMid + fSide;
+	fR = fMid - fSide;
+
+	// normalize
+	fL *= paula->fMixNormalize;
+	fR *= paula->fMixNormalize;
+
+	// left channel - 1-bit triangular dithering
+	fPrng = (float)random32(paula) * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
+	fOut = (fL + fPrng) - paula->fPrngStateL;
+	paula->fPrngStateL = fPrng;
+	out32 = (int32_t)fOut;
+	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+
+	// right channel - 1-bit triangular dithering
+	fPrng = (float)random32(paula) * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
+	fOut = (fR + fPrng) - paula->fPrngStateR;
+	paula->fPrngStateR = fPrng;
+	out32 = (int32_t)fOut;
+	out[1] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+}
+
+static inline void processMixedSamplesMono(paula_t *paula, uint32_t i, int16_t *out, const float fNormalize)
+{
+	// normalize (fNormalize includes the mid factor, so the level is the same as stereo with 0% separation)
+	const float fM = paula->fMixBufferL[i] * fNormalize;
+
+	// 1-bit triangular dithering
+	const float fPrng = (float)random32(paula) * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
+	const float fOut = (fM + fPrng) - paula->fPrngStateL;
+	paula->fPrngStateL = fPrng;
+	const int32_t out32 = (int32_t)fOut;
+	out[0] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+}
+
+static inline void storeS24(uint8_t *out, int32_t sample) // 8bb: packed 24-bit, little-endian
+{
+	out[0] = (uint8_t)sample;
+	out[1] = (uint8_t)(sample >> 8);
+	out[2] = (uint8_t)(sample >> 16);
+}
+
+#ifdef PAULA_SSE2
+static inline __m128i mulLo32(__m128i a, __m128i b) // 8bb: SSE2 has no _mm_mullo_epi32()
+{
+	const __m128i vLo = _mm_mul_epu32(a, b);
+	const __m128i vHi = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(vLo, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(vHi, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/* 8bb: LCG jump constants for stepping the dither LCG in 'lanes' L/R lane pairs at once
+** (x*A^(lanes*2) + C), and the first value of each lane (L = odd, R = even).
+*/
+static void setUpDitherLanes(const paula_t *paula, int32_t lanes, uint32_t *seedL, uint32_t *seedR, uint32_t *mul, uint32_t *add)
+{
+	*mul = 1;
+	*add = 0;
+	for (int32_t i = 0; i < lanes*2; i++)
+	{
+		*mul *= 134775813;
+		*add = (*add * 134775813) + 1;
+	}
+
+	uint32_t seed = paula->randSeed;
+	for (int32_t i = 0; i < lanes; i++)
+	{
+		seedL[i] = seed = (seed * 134775813) + 1;
+		seedR[i] = seed = (seed * 134775813) + 1;
+	}
+}
+
+/* 8bb:
+** Post-mix for four frames at a time, from frame i. Returns the frame it stopped at, the rest
+** is left for processMixedSamples()/processMixedSamplesAmigaPanning().
+**
+** The dither LCG is stepped in eight lanes (L and R of four frames), by jumping eight
+** values ahead per step (see setUpDitherLanes()). The previous dither value of each frame
+** is the one of the lane before it, so the output is bit-exact with the per-frame code.
+*/
+static uint32_t processMixedSamplesSSE2(paula_t *paula, int16_t *target, uint32_t i, uint32_t numSamples, bool amigaPanning)
+{
+	if (numSamples-i < 4)
+		return i;
+
+	uint32_t seedL[4], seedR[4], mul, add;
+	setUpDitherLanes(paula, 4, seedL, seedR, &mul, &add);
+
+	const __m128i vLCGMul = _mm_set1_epi32(mul);
+	const __m128i vLCGAdd = _mm_set1_epi32(add);
+	const __m128 vPrngScale = _mm_set1_ps(1.0f / ((float)UINT32_MAX+1.0f));
+	const __m128 vNormalize = _mm_set1_ps(paula->fMixNormalize);
+	const __m128 vMidFactor = _mm_set1_ps(STEREO_NORM_FACTOR);
+	const __m128 vSideFactor = _mm_set1_ps(paula->fSideFactor);
+
+	__m128i vSeedL = _mm_loadu_si128((const __m128i *)seedL);
+	__m128i vSeedR = _mm_loadu_si128((const __m128i *)seedR);
+	__m128i vSeedLast = vSeedR;
+	__m128 vPrngStateL = _mm_set1_ps(paula->fPrngStateL);
+	__m128 vPrngStateR = _mm_set1_ps(paula->fPrngStateR);
+
+	const float *fMixL = paula->fMixBufferL;
+	const float *fMixR = paula->fMixBufferR;
+
+	for (; i+4 <= numSamples; i += 4)
+	{
+		__m128 vL = _mm_loadu_ps(&fMixL[i]);
+		__m128 vR = _mm_loadu_ps(&fMixR[i]);
+
+		if (!amigaPanning)
+		{
+			// apply stereo separation
+			const __m128 vMid  = _mm_mul_ps(_mm_add_ps(vL, vR), vMidFactor);
+			const __m128 vSide = _mm_mul_ps(_mm_sub_ps(vL, vR), vSideFactor);
+			vL = _mm_add_ps(vMid, vSide);
+			vR = _mm_sub_ps(vMid, vSide);
+		}
+
+		// normalize
+		vL = _mm_mul_ps(vL, vNormalize);
+		vR = _mm_mul_ps(vR, vNormalize);
+
+		// 1-bit triangular dithering
+		const __m128 vPrngL = _mm_mul_ps(_mm_cvtepi32_ps(vSeedL), vPrngScale); // -0.5f .. 0.5f
+		const __m128 vPrngR = _mm_mul_ps(_mm_cvtepi32_ps(vSeedR), vPrngScale);
+
+		// 8bb: previous dither values, {last of previous block, 0, 1, 2}
+		const __m128 vLastL = _mm_shuffle_ps(vPrngStateL, vPrngL, _MM_SHUFFLE(0, 0, 3, 3));
+		const __m128 vLastR = _mm_shuffle_ps(vPrngStateR, vPrngR, _MM_SHUFFLE(0, 0, 3, 3));
+		vL = _mm_sub_ps(_mm_add_ps(vL, vPrngL), _mm_shuffle_ps(vLastL, vPrngL, _MM_SHUFFLE(2, 1, 2, 0)));
+		vR = _mm_sub_ps(_mm_add_ps(vR, vPrngR), _mm_shuffle_ps(vLastR, vPrngR, _MM_SHUFFLE(2, 1, 2, 0)));
+		vPrngStateL = vPrngL;
+		vPrngStateR = vPrngR;
+
+		vSeedLast = vSeedR; // 8bb: the LCG state after this block is its last R value
+		vSeedL = _mm_add_epi32(mulLo32(vSeedL, vLCGMul), vLCGAdd);
+		vSeedR = _mm_add_epi32(mulLo32(vSeedR, vLCGMul), vLCGAdd);
+
+		// quantize (truncate, then clamp to 16-bit with a saturating pack), and interleave
+		const __m128i vOutL = _mm_cvttps_epi32(vL);
+		const __m128i vOutR = _mm_cvttps_epi32(vR);
+		const __m128i vOut = _mm_packs_epi32(_mm_unpacklo_epi32(vOutL, vOutR), _mm_unpackhi_epi32(vOutL, vOutR));
+		_mm_storeu_si128((__m128i *)&target[i*2], vOut);
+	}
+
+	paula->randSeed = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(vSeedLast, _MM_SHUFFLE(3, 3, 3, 3)));
+	paula->fPrngStateL = _mm_cvtss_f32(_mm_shuffle_ps(vPrngStateL, vPrngStateL, _MM_SHUFFLE(3, 3, 3, 3)));
+	paula->fPrngStateR = _mm_cvtss_f32(_mm_shuffle_ps(vPrngStateR, vPrngStateR, _MM_SHUFFLE(3, 3, 3, 3)));
+
+	return i;
+}
+
+// 8bb: mono version of processMixedSamplesSSE2(), the dither LCG runs in four lanes (one per frame)
+static uint32_t processMixedSamplesMonoSSE2(paula_t *paula, int16_t *target, uint32_t i, uint32_t numSamples, const float fNormalize)
+{
+	if (numSamples-i < 8)
+		return i;
+
+	uint32_t seed[4], mul = 1, add = 0, x = paula->randSeed;
+	for (int32_t k = 0; k < 4; k++)
+	{
+		seed[k] = x = (x * 134775813) + 1;
+		mul *= 134775813;
+		add = (add * 134775813) + 1;
+	}
+
+	const __m128i vLCGMul = _mm_set1_epi32(mul);
+	const __m128i vLCGAdd = _mm_set1_epi32(add);
+	const __m128 vPrngScale = _mm_set1_ps(1.0f / ((float)UINT32_MAX+1.0f));
+	const __m128 vNormalize = _mm_set1_ps(fNormalize);
+
+	__m128i vSeed = _mm_loadu_si128((const __m128i *)seed);
+	__m128i vSeedLast = vSeed;
+	__m128 vPrngState = _mm_set1_ps(paula->fPrngStateL);
+
+	const float *fMix = paula->fMixBufferL;
+	for (; i+8 <= numSamples; i += 8) // 8bb: two steps per loop, so that a whole SSE register of int16 gets stored
+	{
+		__m128 vOut[2];
+		for (int32_t k = 0; k < 2; k++)
+		{
+			const __m128 vM = _mm_mul_ps(_mm_loadu_ps(&fMix[i+(k*4)]), vNormalize);
+
+			// 1-bit triangular dithering, previous dither values are {last of previous step, 0, 1, 2}
+			const __m128 vPrng = _mm_mul_ps(_mm_cvtepi32_ps(vSeed), vPrngScale); // -0.5f .. 0.5f
+			const __m128 vLast = _mm_shuffle_ps(vPrngState, vPrng, _MM_SHUFFLE(0, 0, 3, 3));
+			vOut[k] = _mm_sub_ps(_mm_add_ps(vM, vPrng), _mm_shuffle_ps(vLast, vPrng, _MM_SHUFFLE(2, 1, 2, 0)));
+			vPrngState = vPrng;
+
+			vSeedLast = vSeed; // 8bb: the LCG state after this step is its last value
+			vSeed = _mm_add_epi32(mulLo32(vSeed, vLCGMul), vLCGAdd);
+		}
+
+		// quantize (truncate, then clamp to 16-bit with a saturating pack)
+		_mm_storeu_si128((__m128i *)&target[i], _mm_packs_epi32(_mm_cvttps_epi32(vOut[0]), _mm_cvttps_epi32(vOut[1])));
+	}
+
+	paula->randSeed = (uint32_t)_mm_cvtsi128_si32(_mm_shuffle_epi32(vSeedLast, _MM_SHUFFLE(3, 3, 3, 3)));
+	paula->fPrngStateL = _mm_cvtss_f32(_mm_shuffle_ps(vPrngState, vPrngState, _MM_SHUFFLE(3, 3, 3, 3)));
+
+	return i;
+}
+
+#ifdef PAULA_AVX
+/* 8bb: Same as processMixedSamplesSSE2(), for eight frames at a time. The previous dither
+** values are the dither values rotated up by one lane, with lane 0 from the previous block.
+*/
+static TARGET_AVX2 uint32_t processMixedSamplesAVX2(paula_t *paula, int16_t *target, uint32_t i, uint32_t numSamples, bool amigaPanning)
+{
+	if (numSamples-i < 8)
+		return i;
+
+	uint32_t seedL[8], seedR[8], mul, add;
+	setUpDitherLanes(paula, 8, seedL, seedR, &mul, &add);
+
+	const __m256i vLCGMul = _mm256_set1_epi32(mul);
+	const __m256i vLCGAdd = _mm256_set1_epi32(add);
+	const __m256i vRotate = _mm256_setr_epi32(7, 0, 1, 2, 3, 4, 5, 6);
+	const __m256 vPrngScale = _mm256_set1_ps(1.0f / ((float)UINT32_MAX+1.0f));
+	const __m256 vNormalize = _mm256_set1_ps(paula->fMixNormalize);
+	const __m256 vMidFactor = _mm256_set1_ps(STEREO_NORM_FACTOR);
+	const __m256 vSideFactor = _mm256_set1_ps(paula->fSideFactor);
+
+	__m256i vSeedL = _mm256_loadu_si256((const __m256i *)seedL);
+	__m256i vSeedR = _mm256_loadu_si256((const __m256i *)seedR);
+	__m256i vSeedLast = vSeedR;
+	__m256 vLastL = _mm256_set1_ps(paula->fPrngStateL); // 8bb: lane 0 = previous dither value
+	__m256 vLastR = _mm256_set1_ps(paula->fPrngStateR);
+
+	const float *fMixL = paula->fMixBufferL;
+	const float *fMixR = paula->fMixBufferR;
+
+	for (; i+8 <= numSamples; i += 8)
+	{
+		__m256 vL = _mm256_loadu_ps(&fMixL[i]);
+		__m256 vR = _mm256_loadu_ps(&fMixR[i]);
+
+		if (!amigaPanning)
+		{
+			// apply stereo separation
+			const __m256 vMid  = _mm256_mul_ps(_mm256_add_ps(vL, vR), vMidFactor);
+			const __m256 vSide = _mm256_mul_ps(_mm256_sub_ps(vL, vR), vSideFactor);
+			vL = _mm256_add_ps(vMid, vSide);
+			vR = _mm256_sub_ps(vMid, vSide);
+		}
+
+		// normalize
+		vL = _mm256_mul_ps(vL, vNormalize);
+		vR = _mm256_mul_ps(vR, vNormalize);
+
+		// 1-bit triangular dithering
+		const __m256 vPrngL = _mm256_mul_ps(_mm256_cvtepi32_ps(vSeedL), vPrngScale); // -0.5f .. 0.5f
+		const __m256 vPrngR = _mm256_mul_ps(_mm256_cvtepi32_ps(vSeedR), vPrngScale);
+
+		const __m256 vRotL = _mm256_permutevar8x32_ps(vPrngL, vRotate);
+		const __m256 vRotR = _mm256_permutevar8x32_ps(vPrngR, vRotate);
+		vL = _mm256_sub_ps(_mm256_add_ps(vL, vPrngL), _mm256_blend_ps(vRotL, vLastL, 1));
+		vR = _mm256_sub_ps(_mm256_add_ps(vR, vPrngR), _mm256_blend_ps(vRotR, vLastR, 1));
+		vLastL = vRotL;
+		vLastR = vRotR;
+
+		vSeedLast = vSeedR;
+		vSeedL = _mm256_add_epi32(_mm256_mullo_epi32(vSeedL, vLCGMul), vLCGAdd);
+		vSeedR = _mm256_add_epi32(_mm256_mullo_epi32(vSeedR, vLCGMul), vLCGAdd);
+
+		// quantize and interleave (unpack and pack work within 128-bit halves, which keeps the frames in order)
+		const __m256i vOutL = _mm256_cvttps_epi32(vL);
+		const __m256i vOutR = _mm256_cvttps_epi32(vR);
+		const __m256i vOut = _mm256_packs_epi32(_mm256_unpacklo_epi32(vOutL, vOutR), _mm256_unpackhi_epi32(vOutL, vOutR));
+		_mm256_storeu_si256((__m256i *)&target[i*2], vOut);
+	}
+
+	paula->randSeed = (uint32_t)_mm256_extract_epi32(vSeedLast, 7);
+	paula->fPrngStateL = _mm256_cvtss_f32(vLastL);
+	paula->fPrngStateR = _mm256_cvtss_f32(vLastR);
+
+	return i;
+}
+
+static TARGET_AVX512 uint32_t processMixedSamplesAVX512(paula_t *paula, int16_t *target, uint32_t i, uint32_t numSamples, bool amigaPanning)
+{
+	if (numSamples-i < 16)
+		return i;
+
+	uint32_t seedL[16], seedR[16], mul, add;
+	setUpDitherLanes(paula, 16, seedL, seedR, &mul, &add);
+
+	const __m512i vLCGMul = _mm512_set1_epi32(mul);
+	const __m512i vLCGAdd = _mm512_set1_epi32(add);
+	const __m512i vRotate = _mm512_setr_epi32(15, 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14);
+	const __m512 vPrngScale = _mm512_set1_ps(1.0f / ((float)UINT32_MAX+1.0f));
+	const __m512 vNormalize = _mm512_set1_ps(paula->fMixNormalize);
+	const __m512 vMidFactor = _mm512_set1_ps(STEREO_NORM_FACTOR);
+	const __m512 vSideFactor = _mm512_set1_ps(paula->fSideFactor);
+
+	__m512i vSeedL = _mm512_loadu_si512(seedL);
+	__m512i vSeedR = _mm512_loadu_si512(seedR);
+	__m512i vSeedLast = vSeedR;
+	__m512 vLastL = _mm512_set1_ps(paula->fPrngStateL); // 8bb: lane 0 = previous dither value
+	__m512 vLastR = _mm512_set1_ps(paula->fPrngStateR);
+
+	const float *fMixL = paula->fMixBufferL;
+	const float *fMixR = paula->fMixBufferR;
+
+	for (; i+16 <= numSamples; i += 16)
+	{
+		__m512 vL = _mm512_loadu_ps(&fMixL[i]);
+		__m512 vR = _mm512_loadu_ps(&fMixR[i]);
+
+		if (!amigaPanning)
+		{
+			// apply stereo separation
+			const __m512 vMid  = _mm512_mul_ps(_mm512_add_ps(vL, vR), vMidFactor);
+			const __m512 vSide = _mm512_mul_ps(_mm512_sub_ps(vL, vR), vSideFactor);
+			vL = _mm512_add_ps(vMid, vSide);
+			vR = _mm512_sub_ps(vMid, vSide);
+		}
+
+		// normalize
+		vL = _mm512_mul_ps(vL, vNormalize);
+		vR = _mm512_mul_ps(vR, vNormalize);
+
+		// 1-bit triangular dithering
+		const __m512 vPrngL = _mm512_mul_ps(_mm512_cvtepi32_ps(vSeedL), vPrngScale); // -0.5f .. 0.5f
+		const __m512 vPrngR = _mm512_mul_ps(_mm512_cvtepi32_ps(vSeedR), vPrngScale);
+
+		const __m512 vRotL = _mm512_permutexvar_ps(vRotate, vPrngL);
+		const __m512 vRotR = _mm512_permutexvar_ps(vRotate, vPrngR);
+		vL = _mm512_sub_ps(_mm512_add_ps(vL, vPrngL), _mm512_mask_blend_ps(1, vRotL, vLastL));
+		vR = _mm512_sub_ps(_mm512_add_ps(vR, vPrngR), _mm512_mask_blend_ps(1, vRotR, vLastR));
+		vLastL = vRotL;
+		vLastR = vRotR;
+
+		vSeedLast = vSeedR;
+		vSeedL = _mm512_add_epi32(_mm512_mullo_epi32(vSeedL, vLCGMul), vLCGAdd);
+		vSeedR = _mm512_add_epi32(_mm512_mullo_epi32(vSeedR, vLCGMul), vLCGAdd);
+
+		// quantize and interleave (see processMixedSamplesAVX2())
+		const __m512i vOutL = _mm512_cvttps_epi32(vL);
+		const __m512i vOutR = _mm512_cvttps_epi32(vR);
+		const __m512i vOut = _mm512_packs_epi32(_mm512_unpacklo_epi32(vOutL, vOutR), _mm512_unpackhi_epi32(vOutL, vOutR));
+		_mm512_storeu_si512(&target[i*2], vOut);
+	}
+
+	uint32_t seedLast[16];
+	_mm512_storeu_si512(seedLast, vSeedLast);
+
+	paula->randSeed = seedLast[15];
+	paula->fPrngStateL = _mm512_cvtss_f32(vLastL);
+	paula->fPrngStateR = _mm512_cvtss_f32(vLastR);
+
+	return i;
+}
+#endif
+#endif
+
+#ifdef PAULA_SSE2
+// 8bb: PAULA_FORMAT_F32 post-mix for four frames at a time, same math as processMixedSamplesUndithered()
+static uint32_t processMixedSamplesFloatSSE2(paula_t *paula, float *target, uint32_t i, uint32_t numSamples, bool amigaPanning, const float fScale)
+{
+	const __m128 vScale = _mm_set1_ps(fScale);
+	const __m128 vZero = _mm_setzero_ps();
+	const float *fMixL = paula->fMixBufferL;
+	const float *fMixR = paula->fMixBufferR;
+
+	if (paula->audio.channels == 1)
+	{
+		const __m128 vNormalize = _mm_set1_ps(paula->fMixNormalize * STEREO_NORM_FACTOR);
+		for (; i+4 <= numSamples; i += 4)
+			_mm_storeu_ps(&target[i], _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(&fMixL[i]), vNormalize), vScale), vZero));
+
+		return i;
+	}
+
+	const __m128 vNormalize = _mm_set1_ps(paula->fMixNormalize);
+	const __m128 vMidFactor = _mm_set1_ps(STEREO_NORM_FACTOR);
+	const __m128 vSideFactor = _mm_set1_ps(paula->fSideFactor);
+
+	for (; i+4 <= numSamples; i += 4)
+	{
+		__m128 vL = _mm_loadu_ps(&fMixL[i]);
+		__m128 vR = _mm_loadu_ps(&fMixR[i]);
+
+		if (!amigaPanning)
+		{
+			// apply stereo separation
+			const __m128 vMid  = _mm_mul_ps(_mm_add_ps(vL, vR), vMidFactor);
+			const __m128 vSide = _mm_mul_ps(_mm_sub_ps(vL, vR), vSideFactor);
+			vL = _mm_add_ps(vMid, vSide);
+			vR = _mm_sub_ps(vMid, vSide);
+		}
+
+		// normalize and scale
+		vL = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(vL, vNormalize), vScale), vZero);
+		vR = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(vR, vNormalize), vScale), vZero);
+
+		// interleave
+		_mm_storeu_ps(&target[(i*2)+0], _mm_unpacklo_ps(vL, vR));
+		_mm_storeu_ps(&target[(i*2)+4], _mm_unpackhi_ps(vL, vR));
+	}
+
+	return i;
+}
+#endif
+
+/* 8bb: Undithered output formats (see paulaSetOutputFormat()). The mix is the same as for
+** 16-bit output, it's only scaled by a power of two instead of being dithered: 1/32768 for
+** F32 (-1.0 .. 1.0, not clipped), 256 for S24 (rounded to nearest, then clipped).
+*/
+static void processMixedSamplesUndithered(paula_t *paula, void *target, uint32_t numSamples)
+{
+	const bool amigaPanning = (paula->audio.stereoSeparation == 100);
+	const int32_t channels = paula->audio.channels;
+	const bool floatOutput = (paula->audio.format == PAULA_FORMAT_F32);
+	const float fScale = floatOutput ? (1.0f / 32768.0f) : 256.0f;
+
+	uint32_t i = 0;
+#ifdef PAULA_SSE2
+	if (floatOutput && paula->audio.simd >= PAULA_SIMD_SSE2)
+		i = processMixedSamplesFloatSSE2(paula, (float *)target, i, numSamples, amigaPanning, fScale);
+#endif
+
+	for (; i < numSamples; i++)
+	{
+		float fOut[2];
+
+		if (channels == 1)
+		{
+			fOut[0] = paula->fMixBufferL[i] * (paula->fMixNormalize * STEREO_NORM_FACTOR);
+		}
+		else
+		{
+			float fL = paula->fMixBufferL[i];
+			float fR = paula->fMixBufferR[i];
+
+			if (!amigaPanning) // apply stereo separation
+			{
+				const float fMid  = (fL + fR) * STEREO_NORM_FACTOR;
+				const float fSide = (fL - fR) * paula->fSideFactor;
+				fL = fMid + fSide;
+				fR = fMid - fSide;
+			}
+
+			// normalize
+			fOut[0] = fL * paula->fMixNormalize;
+			fOut[1] = fR * paula->fMixNormalize;
+		}
+
+		for (int32_t c = 0; c < channels; c++)
+		{
+			const float fSample = fOut[c] * fScale;
+
+			if (floatOutput)
+			{
+				((float *)target)[(i * channels) + c] = fSample + 0.0f; // 8bb: the SSE2 mixer can give -0.0f where the plain C one gives 0.0f
+			}
+			else
+			{
+				const float fClamped = CLAMP(fSample, -8388608.0f, 8388607.0f);
+				storeS24(&((uint8_t *)target)[((i * channels) + c) * 3], (int32_t)lrintf(fClamped));
+			}
+		}
+	}
+}
+
+/* 8bb: Stems (see paulaMixSamplesStems()) and 4-channel output. A voice is normalized like a channel with
+** Amiga panning, and then dithered (S16, with the voice's own dither state), rounded (S24) or scaled (F32)
+** like the mix. stride is in samples (1 for stems, 4 for interleaved 4-channel frames).
+*/
+static void processStems(paula_t *paula, void *const *stems, int32_t stride, uint32_t numSamples)
+{
+	const int32_t format = paula->audio.format;
+
+	for (int32_t v = 0; v < PAULA_VOICES; v++)
+	{
+		if (stems[v] == NULL)
+			continue;
+
+		const float *fVoice = paula->fVoiceBuffer[v];
+		if (format == PAULA_FORMAT_F32)
+		{
+			float *target = (float *)stems[v];
+			for (uint32_t i = 0; i < numSamples; i++)
+				target[i * stride] = ((fVoice[i] * paula->fMixNormalize) * (1.0f / 32768.0f)) + 0.0f;
+		}
+		else if (format == PAULA_FORMAT_S24)
+		{
+			uint8_t *target = (uint8_t *)stems[v];
+			for (uint32_t i = 0; i < numSamples; i++)
+			{
+				const float fSample = (fVoice[i] * paula->fMixNormalize) * 256.0f;
+				const float fClamped = CLAMP(fSample, -8388608.0f, 8388607.0f);
+				storeS24(&target[i * stride * 3], (int32_t)lrintf(fClamped));
+			}
+		}
+		else
+		{
+			int16_t *target = (int16_t *)stems[v];
+			float fPrngState = paula->fStemPrngState[v];
+
+			for (uint32_t i = 0; i < numSamples; i++)
+			{
+				// 1-bit triangular dithering
+				const float fPrng = (float)randomLCG(&paula->stemRandSeed[v]) * (1.0f / ((float)UINT32_MAX+1.0f)); // -0.5f .. 0.5f
+				const float fOut = ((fVoice[i] * paula->fMixNormalize) + fPrng) - fPrngState;
+				fPrngState = fPrng;
+				const int32_t out32 = (int32_t)fOut;
+				target[i * stride] = (int16_t)(CLAMP(out32, INT16_MIN, INT16_MAX));
+			}
+
+			paula->fStemPrngState[v] = fPrngState;
+		}
+	}
+}
+
+/* 8bb: Fixed-point mixer (see paulaSetFixedPoint()). Same as the float mixer, but with 0.32 phase
+** accumulators, the 1.15 BLEP tables and integer dithering. There is no floating-point math per
+** sample, and the output is bit-exact on every platform.
+*/
+static inline void nextSampleFixed(paulaVoice_t *v, blep_t *b, const blepTapsFixed_t *t, const int32_t blepLength)
+{
+	v->sample = fetchSample(v) * v->storedVol; // -128..127 * 0..64
+
+	// fill BLEP buffer if the new sample differs from the old one
+	if (v->sample != b->lastValue)
+	{
+		if (blepLength > 0 && v->blepDelta > v->blepPhase) // also checks if v->blepDelta > 0
+		{
+			const uint32_t blepOffset = (uint32_t)(((uint64_t)v->blepPhase << 20) / v->blepDelta); // 4.16
+			blepAddFixed(b, t, blepLength, blepOffset, b->lastValue - v->sample);
+		}
+
+		b->lastValue = v->sample;
+	}
+}
+
+static inline bool voiceIsSilentFixed(const paulaVoice_t *v, const blep_t *b)
+{
+	return v->storedVol == 0 && v->sample == 0 && b->lastValue == 0 && b->samplesLeft == 0;
+}
+
+static void advanceSilentVoiceFixed(paulaVoice_t *v, int32_t numSamples) // 8bb: see advanceSilentVoice(), integer phase steps add up exactly, so this is done in one go
+{
+	if (v->nextSampleStage)
+	{
+		v->nextSampleStage = false;
+		v->sample = fetchSample(v) * v->storedVol;
+	}
+
+	if (v->delta == 0)
+		return;
+
+	// 8bb: up to the first sampling step (the delta is refetched there)
+	const uint32_t samplesToStep = (((uint32_t)(0 - v->phase) - 1) / v->delta) + 1; // ceil((2^32 - phase) / delta)
+	if (samplesToStep > (uint32_t)numSamples)
+	{
+		v->phase += v->delta * (uint32_t)numSamples;
+		return;
+	}
+
+	v->phase += v->delta * samplesToStep;
+	refetchPeriod(v);
+
+	const uint32_t samplesLeft = (uint32_t)numSamples - samplesToStep;
+	if (samplesLeft == 0 || v->delta == 0)
+		return; // 8bb: sample point is fetched on the next block
+
+	v->nextSampleStage = false;
+	v->sample = fetchSample(v) * v->storedVol;
+
+	// 8bb: the rest of the block, with a constant delta
+	const uint64_t phase64 = v->phase + ((uint64_t)v->delta * samplesLeft);
+	const uint32_t steps = (uint32_t)(phase64 >> 32);
+	const uint32_t phase = (uint32_t)phase64;
+
+	if (steps > 0)
+	{
+		const bool stepOnLastSample = (phase < v->delta); // 8bb: then the sample point is fetched on the next block
+
+		for (uint32_t i = stepOnLastSample ? 1 : 0; i < steps; i++)
+			fetchSample(v);
+
+		v->blepPhase = phase % v->delta; // 8bb: phase after the last sampling step
+		v->blepDelta = v->delta;
+		v->nextSampleStage = stepOnLastSample;
+	}
+
+	v->phase = phase;
+}
+
+// 8bb: stems renders every voice into its own buffer (voiceOut[0..3]) instead, see generateSamples()
+static FORCE_INLINE void generateSamplesFixed(paula_t *paula, int32_t *outL, int32_t *outR, int32_t *const *voiceOut, int32_t numSamples,
+	const blepTapsFixed_t *t, const int32_t blepLength, const bool mono, const bool stems)
+{
+	int32_t *mixBufSelect[PAULA_VOICES];
+
+	if (numSamples <= 0)
+		return;
+
+	if (stems)
+	{
+		for (int32_t i = 0; i < PAULA_VOICES; i++)
+		{
+			mixBufSelect[i] = voiceOut[i];
+			memset(voiceOut[i], 0, numSamples * sizeof (int32_t));
+		}
+	}
+	else
+	{
+		mixBufSelect[0] = outL;
+		mixBufSelect[1] = mono ? outL : outR;
+		mixBufSelect[2] = mono ? outL : outR;
+		mixBufSelect[3] = outL;
+
+		// clear mix buffer block
+		memset(outL, 0, numSamples * sizeof (int32_t));
+		if (!mono)
+			memset(outR, 0, numSamples * sizeof (int32_t));
+	}
+
+	// mix samples
+
+	const int32_t disabledVoices = paula->audio.disabledVoices;
+	paulaVoice_t *v = paula->voice;
+	blep_t *b = paula->blep;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++, v++, b++)
+	{
+		if (!v->active || v->location == NULL || v->storedLocation == NULL || (disabledVoices & (1 << i)))
+			continue;
+
+		if (voiceIsSilentFixed(v, b))
+		{
+			advanceSilentVoiceFixed(v, numSamples);
+			continue;
+		}
+
+		int32_t *mixBuffer = mixBufSelect[i]; // what output channel to mix into (L, R, R, L, all in L for mono, or the voice's own)
+		for (int32_t j = 0; j < numSamples;)
+		{
+			if (v->nextSampleStage)
+			{
+				v->nextSampleStage = false;
+				nextSampleFixed(v, b, t, blepLength); // inlined
+			}
+
+			// 8bb: find the next sampling step (phase wraps around), then mix the whole span at once
+			bool refetch;
+			int32_t spanEnd = j;
+			do
+			{
+				v->phase += v->delta;
+				refetch = (v->phase < v->delta);
+				spanEnd++;
+			}
+			while (!refetch && spanEnd < numSamples);
+
+			const int32_t sample = v->sample * 256; // 24.8
+
+			for (; j < spanEnd && b->samplesLeft > 0; j++) // pending BLEP tail
+				mixBuffer[j] += blepRunFixed(b, sample);
+
+			for (; j < spanEnd; j++)
+				mixBuffer[j] += sample;
+
+			if (refetch)
+				refetchPeriod(v);
+		}
+	}
+}
+
+// 8bb: outR = NULL mixes all four voices into outL (mono), voiceOut != NULL also gives the stems (see paulaGenerateSamples())
+// 8bb: outL = NULL (with voiceOut) skips the mix
+static void paulaGenerateSamplesFixed(paula_t *paula, int32_t *outL, int32_t *outR, int32_t *const *voiceOut, int32_t numSamples)
+{
+	const int32_t quality = paula->adapt.enabled ? paula->adapt.quality : paula->audio.quality;
+	const bool mono = (outR == NULL);
+
+	if (voiceOut != NULL)
+	{
+		switch (quality)
+		{
+			default:
+			case PAULA_QUALITY_BLEP:
+				generateSamplesFixed(paula, NULL, NULL, voiceOut, numSamples, &paula->blepTapsFixed, BLEP_NS, false, true);
+				break;
+
+			case PAULA_QUALITY_SHORT_BLEP:
+				generateSamplesFixed(paula, NULL, NULL, voiceOut, numSamples, &paula->blepTapsFixedShort, BLEP_SHORT_NS, false, true);
+				break;
+
+			case PAULA_QUALITY_NO_BLEP:
+				generateSamplesFixed(paula, NULL, NULL, voiceOut, numSamples, NULL, 0, false, true);
+				break;
+		}
+
+		// 8bb: sum the stems up to the mix (integers, so the order doesn't matter here)
+		if (outL == NULL) // 8bb: voices only (4 channels)
+			return;
+
+		if (mono)
+		{
+			for (int32_t i = 0; i < numSamples; i++)
+				outL[i] = voiceOut[0][i] + voiceOut[1][i] + voiceOut[2][i] + voiceOut[3][i];
+		}
+		else
+		{
+			for (int32_t i = 0; i < numSamples; i++)
+			{
+				outL[i] = voiceOut[0][i] + voiceOut[3][i];
+				outR[i] = voiceOut[1][i] + voiceOut[2][i];
+			}
+		}
+
+		return;
+	}
+
+	switch (quality)
+	{
+		default:
+		case PAULA_QUALITY_BLEP:
+			if (mono)
+				generateSamplesFixed(paula, outL, NULL, NULL, numSamples, &paula->blepTapsFixed, BLEP_NS, true, false);
+			else
+				generateSamplesFixed(paula, outL, outR, NULL, numSamples, &paula->blepTapsFixed, BLEP_NS, false, false);
+			break;
+
+		case PAULA_QUALITY_SHORT_BLEP:
+			if (mono)
+				generateSamplesFixed(paula, outL, NULL, NULL, numSamples, &paula->blepTapsFixedShort, BLEP_SHORT_NS, true, false);
+			else
+				generateSamplesFixed(paula, outL, outR, NULL, numSamples, &paula->blepTapsFixedShort, BLEP_SHORT_NS, false, false);
+			break;
+
+		case PAULA_QUALITY_NO_BLEP:
+			if (mono)
+				generateSamplesFixed(paula, outL, NULL, NULL, numSamples, NULL, 0, true, false);
+			else
+				generateSamplesFixed(paula, outL, outR, NULL, numSamples, NULL, 0, false, false);
+			break;
+	}
+}
+
+static inline int16_t ditherFixed(uint32_t *seed, int32_t out, int32_t *prngState) // 8bb: 16.16 -> int16
+{
+	// 1-bit triangular dithering
+	const int32_t prng = randomLCG(seed) >> 16; // -0.5 .. 0.5 (16.16)
+	const int64_t out64 = ((int64_t)out + prng) - *prngState;
+	*prngState = prng;
+
+	const int64_t out16 = out64 / 65536; // 8bb: rounds towards zero, like the float mixer
+	const int32_t out32 = (int32_t)(CLAMP(out16, INT16_MIN, INT16_MAX));
+	return (int16_t)out32;
+}
+
+static inline void processMixedSamplesFixedAmigaPanning(paula_t *paula, uint32_t i, int16_t *out)
+{
+	int64_t l = paula->mixBufferL[i];
+	int64_t r = paula->mixBufferR[i];
+
+	// normalize (24.8 -> 16.16)
+	l = (l * paula->mixNormalize) >> 8;
+	r = (r * paula->mixNormalize) >> 8;
+
+	out[0] = ditherFixed(&paula->randSeed, (int32_t)CLAMP(l, INT32_MIN, INT32_MAX), &paula->prngStateL);
+	out[1] = ditherFixed(&paula->randSeed, (int32_t)CLAMP(r, INT32_MIN, INT32_MAX), &paula->prngStateR);
+}
+
+static inline void processMixedSamplesFixed(paula_t *paula, uint32_t i, int16_t *out)
+{
+	int64_t l = paula->mixBufferL[i];
+	int64_t r = paula->mixBufferR[i];
+
+	// apply stereo separation (sideFactor is 0.16)
+	const int64_t mid = l + r;
+	const int64_t side = ((l - r) * paula->sideFactor) >> 16;
+	l = (mid + side) >> 1;
+	r = (mid - side) >> 1;
+
+	// normalize (24.8 -> 16.16)
+	l = (l * paula->mixNormalize) >> 8;
+	r = (r * paula->mixNormalize) >> 8;
+
+	out[0] = ditherFixed(&paula->randSeed, (int32_t)CLAMP(l, INT32_MIN, INT32_MAX), &paula->prngStateL);
+	out[1] = ditherFixed(&paula->randSeed, (int32_t)CLAMP(r, INT32_MIN, INT32_MAX), &paula->prngStateR);
+}
+
+static inline void processMixedSamplesFixedMono(paula_t *paula, uint32_t i, int16_t *out)
+{
+	// 8bb: same level as stereo with 0% separation, (L+R)/2
+	int64_t m = paula->mixBufferL[i] >> 1;
+
+	// normalize (24.8 -> 16.16)
+	m = (m * paula->mixNormalize) >> 8;
+
+	out[0] = ditherFixed(&paula->randSeed, (int32_t)CLAMP(m, INT32_MIN, INT32_MAX), &paula->prngStateL);
+}
+
+/* 8bb: Undithered output formats (see paulaSetOutputFormat()), same mix as above.
+** S24 is rounded (half up) from 16.16, F32 is scaled from 16.16 by a power of two.
+*/
+static void processMixedSamplesFixedUndithered(paula_t *paula, void *target, uint32_t numSamples)
+{
+	const bool amigaPanning = (paula->audio.stereoSeparation == 100);
+	const int32_t channels = paula->audio.channels;
+
+	for (uint32_t i = 0; i < numSamples; i++)
+	{
+		int64_t out[2];
+
+		if (channels == 1)
+		{
+			out[0] = paula->mixBufferL[i] >> 1;
+		}
+		else
+		{
+			out[0] = paula->mixBufferL[i];
+			out[1] = paula->mixBufferR[i];
+
+			if (!amigaPanning) // apply stereo separation
+			{
+				const int64_t mid = out[0] + out[1];
+				const int64_t side = ((out[0] - out[1]) * paula->sideFactor) >> 16;
+				out[0] = (mid + side) >> 1;
+				out[1] = (mid - side) >> 1;
+			}
+		}
+
+		for (int32_t c = 0; c < channels; c++)
+		{
+			const int64_t out64 = (out[c] * paula->mixNormalize) >> 8; // normalize (24.8 -> 16.16)
+
+			if (paula->audio.format == PAULA_FORMAT_F32)
+			{
+				((float *)target)[(i * channels) + c] = (float)out64 * (1.0f / (65536.0f * 32768.0f));
+			}
+			else
+			{
+				const int64_t out24 = (out64 + 128) >> 8;
+				storeS24(&((uint8_t *)target)[((i * channels) + c) * 3], (int32_t)CLAMP(out24, -8388608, 8388607));
+			}
+		}
+	}
+}
+
+// 8bb: stems and 4-channel output, same as processStems() (normalized like a channel with Amiga panning)
+static void processStemsFixed(paula_t *paula, void *const *stems, int32_t stride, uint32_t numSamples)
+{
+	const int32_t format = paula->audio.format;
+
+	for (int32_t v = 0; v < PAULA_VOICES; v++)
+	{
+		if (stems[v] == NULL)
+			continue;
+
+		const int32_t *voice = paula->voiceBuffer[v];
+		for (uint32_t i = 0; i < numSamples; i++)
+		{
+			const int64_t out64 = ((int64_t)voice[i] * paula->mixNormalize) >> 8; // normalize (24.8 -> 16.16)
+
+			if (format == PAULA_FORMAT_F32)
+			{
+				((float *)stems[v])[i * stride] = (float)out64 * (1.0f / (65536.0f * 32768.0f));
+			}
+			else if (format == PAULA_FORMAT_S24)
+			{
+				const int64_t out24 = (out64 + 128) >> 8;
+				storeS24(&((uint8_t *)stems[v])[i * stride * 3], (int32_t)CLAMP(out24, -8388608, 8388607));
+			}
+			else
+			{
+				((int16_t *)stems[v])[i * stride] = ditherFixed(&paula->stemRandSeed[v], (int32_t)CLAMP(out64, INT32_MIN, INT32_MAX), &paula->stemPrngState[v]);
+			}
+		}
+	}
+}
+
+/* 8bb: 4-channel output (paulaSetChannels()), one voice per channel, interleaved. The channels are
+** processed like stems, and stems (if any) are then copies of the channels.
+*/
+static void processQuadSamples(paula_t *paula, void *output, void *const *stems, uint32_t numSamples)
+{
+	const int32_t bytesPerSample = paulaGetBytesPerSample(paula);
+	void *channel[PAULA_VOICES];
+
+	if (output == NULL)
+	{
+		if (paula->audio.fixedPoint)
+			processStemsFixed(paula, stems, 1, numSamples);
+		else
+			processStems(paula, stems, 1, numSamples);
+
+		return;
+	}
+
+	for (int32_t v = 0; v < PAULA_VOICES; v++)
+		channel[v] = (uint8_t *)output + (v * bytesPerSample);
+
+	if (paula->audio.fixedPoint)
+		processStemsFixed(paula, channel, PAULA_VOICES, numSamples);
+	else
+		processStems(paula, channel, PAULA_VOICES, numSamples);
+
+	if (stems == NULL)
+		return;
+
+	for (int32_t v = 0; v < PAULA_VOICES; v++)
+	{
+		if (stems[v] == NULL)
+			continue;
+
+		const uint8_t *src = (const uint8_t *)channel[v];
+		uint8_t *dst = (uint8_t *)stems[v];
+
+		for (uint32_t i = 0; i < numSamples; i++)
+			memcpy(&dst[i * bytesPerSample], &src[i * PAULA_VOICES * bytesPerSample], bytesPerSample);
+	}
+}
+
+// 8bb: normalize, adjust stereo separation (if needed) and dither/convert the fixed-point mix
+static void postMixSamplesFixed(paula_t *paula, void *target, uint32_t numSamples)
+{
+	if (paula->audio.format != PAULA_FORMAT_S16)
+	{
+		processMixedSamplesFixedUndithered(paula, target, numSamples);
+		return;
+	}
+
+	if (paula->audio.channels == 1)
+	{
+		for (uint32_t i = 0; i < numSamples; i++)
+			processMixedSamplesFixedMono(paula, i, &((int16_t *)target)[i]);
+
+		return;
+	}
+
+	int16_t *outStream = (int16_t *)target;
+	if (paula->audio.stereoSeparation == 100)
+	{
+		for (uint32_t i = 0; i < numSamples; i++, outStream += 2)
+			processMixedSamplesFixedAmigaPanning(paula, i, outStream);
+	}
+	else
+	{
+		for (uint32_t i = 0; i < numSamples; i++, outStream += 2)
+			processMixedSamplesFixed(paula, i, outStream);
+	}
+}
+
+// 8bb: fills the mix buffers (and the voice buffers for stems or 4 channels) from frame pos, for one segment
+static void generateMixSegment(paula_t *paula, bool stems, uint32_t pos, uint32_t numSamples)
+{
+	const int32_t channels = paula->audio.channels;
+
+	if (paula->audio.fixedPoint)
+	{
+		int32_t *voiceBuffer[PAULA_VOICES];
+		for (int32_t i = 0; i < PAULA_VOICES; i++)
+			voiceBuffer[i] = paula->voiceBuffer[i] + pos;
+
+		if (channels == 4) // 8bb: one voice per channel, no mix
+			paulaGenerateSamplesFixed(paula, NULL, NULL, voiceBuffer, numSamples);
+		else
+			paulaGenerateSamplesFixed(paula, paula->mixBufferL + pos, (channels == 1) ? NULL : paula->mixBufferR + pos,
+				stems ? voiceBuffer : NULL, numSamples);
+
+		return;
+	}
+
+	float *fVoiceBuffer[PAULA_VOICES];
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		fVoiceBuffer[i] = paula->fVoiceBuffer[i] + pos;
+
+	float *fMixBufferL = (channels == 4) ? NULL : paula->fMixBufferL + pos; // 8bb: NULL = no mix
+	float *fMixBufferR = (channels == 2) ? paula->fMixBufferR + pos : NULL; // 8bb: NULL = mono mix
+	float *const *fVoiceOut = (stems || channels == 4) ? fVoiceBuffer : NULL;
+
+	paulaGenerateSamples(paula, fMixBufferL, fMixBufferR, fVoiceOut, numSamples);
+}
+
+/* 8bb: Fills the mix buffers for one block. Queued register events (paulaQueueEvents()) are applied at
+** their frame offsets, so the block is synthesized in segments between them, and the post-mix runs on the
+** whole block. The result is the same as mixing every segment on its own.
+*/
+static void generateMixBlock(paula_t *paula, bool stems, uint32_t numSamples)
+{
+	paulaEventQueue_t *q = &paula->events;
+	q->queueing = false; // 8bb: from here on, register writes are applied at once
+
+	int32_t e = 0;
+	uint32_t pos = 0;
+	while (pos < numSamples)
+	{
+		while (e < q->numEvents && q->event[e].offset <= pos)
+			applyEvent(paula, &q->event[e++]);
+
+		uint32_t end = numSamples;
+		if (e < q->numEvents && q->event[e].offset < end)
+			end = q->event[e].offset;
+
+		generateMixSegment(paula, stems, pos, end - pos);
+		pos = end;
+	}
+
+	while (e < q->numEvents) // 8bb: events past the block (shouldn't happen), don't lose them
+		applyEvent(paula, &q->event[e++]);
+
+	q->numEvents = 0;
+	q->numWaveforms = 0;
+}
+
+// 8bb: turns the generated block into output (and stems), with the current post-mix settings and dither state
+static void postMixSamples(paula_t *paula, void *output, void *const *stems, uint32_t numSamples)
+{
+	if (paula->audio.channels == 4)
+	{
+		processQuadSamples(paula, output, stems, numSamples);
+		return;
+	}
+
+	if (stems != NULL)
+	{
+		if (paula->audio.fixedPoint)
+			processStemsFixed(paula, stems, 1, numSamples);
+		else
+			processStems(paula, stems, 1, numSamples);
+	}
+
+	if (output == NULL) // 8bb: stems only
+		return;
+
+	if (paula->audio.fixedPoint)
+	{
+		postMixSamplesFixed(paula, output, numSamples);
+		return;
+	}
+
+	if (paula->audio.format != PAULA_FORMAT_S16) // normalize, adjust stereo separation (if needed), no dithering
+	{
+		processMixedSamplesUndithered(paula, output, numSamples);
+		return;
+	}
+
+	int16_t *target = (int16_t *)output;
+	if (paula->audio.channels == 1) // normalize, dither and quantize
+	{
+		const float fNormalize = paula->fMixNormalize * STEREO_NORM_FACTOR;
+
+		uint32_t i = 0;
+#ifdef PAULA_SSE2
+		if (paula->audio.simd >= PAULA_SIMD_SSE2) // 8bb: the AVX levels use this one too
+			i = processMixedSamplesMonoSSE2(paula, target, i, numSamples, fNormalize);
+#endif
+		for (; i < numSamples; i++)
+			processMixedSamplesMono(paula, i, &target[i], fNormalize);
+
+		return;
+	}
+
+	// normalize, adjust stereo separation (if needed), dither and quantize
+
+	uint32_t i = 0;
+#ifdef PAULA_SSE2
+	const bool amigaPanning = (paula->audio.stereoSeparation == 100);
+#ifdef PAULA_AVX
+	if (paula->audio.simd == PAULA_SIMD_AVX512)
+		i = processMixedSamplesAVX512(paula, target, i, numSamples, amigaPanning);
+	else if (paula->audio.simd == PAULA_SIMD_AVX2)
+		i = processMixedSamplesAVX2(paula, target, i, numSamples, amigaPanning);
+#endif
+	if (paula->audio.simd >= PAULA_SIMD_SSE2)
+		i = processMixedSamplesSSE2(paula, target, i, numSamples, amigaPanning);
+#endif
+
+	int16_t out[2];
+	int16_t *outStream = &target[i*2];
+	if (paula->audio.stereoSeparation == 100)
+	{
+		for (; i < numSamples; i++)
+		{
+			processMixedSamplesAmigaPanning(paula, i, out);
+			*outStream++ = out[0];
+			*outStream++ = out[1];
+		}
+	}
+	else
+	{
+		for (; i < numSamples; i++)
+		{
+			processMixedSamples(paula, i, out);
+			*outStream++ = out[0];
+			*outStream++ = out[1];
+		}
+	}
+}
+
+/* 8bb: Mix variants (paulaMixSamplesVariants()). The post-mix only reads the mix buffers, so a variant
+** is made by swapping its settings and dither state into the Paula state, running the post-mix again,
+** and swapping back. The output is then the same as from a render with those settings.
+*/
+static void getMixVariant(const paula_t *paula, paulaMixVariant_t *variant)
+{
+	variant->masterVol = paula->audio.masterVol;
+	variant->stereoSeparation = paula->audio.stereoSeparation;
+	variant->fMixNormalize = paula->fMixNormalize;
+	variant->fSideFactor = paula->fSideFactor;
+	variant->mixNormalize = paula->mixNormalize;
+	variant->sideFactor = paula->sideFactor;
+
+	variant->randSeed = paula->randSeed;
+	variant->fPrngStateL = paula->fPrngStateL;
+	variant->fPrngStateR = paula->fPrngStateR;
+	variant->prngStateL = paula->prngStateL;
+	variant->prngStateR = paula->prngStateR;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		variant->stemRandSeed[i] = paula->stemRandSeed[i];
+		variant->fStemPrngState[i] = paula->fStemPrngState[i];
+		variant->stemPrngState[i] = paula->stemPrngState[i];
+	}
+}
+
+static void setMixVariant(paula_t *paula, const paulaMixVariant_t *variant)
+{
+	paula->audio.masterVol = variant->masterVol;
+	paula->audio.stereoSeparation = variant->stereoSeparation;
+	paula->fMixNormalize = variant->fMixNormalize;
+	paula->fSideFactor = variant->fSideFactor;
+	paula->mixNormalize = variant->mixNormalize;
+	paula->sideFactor = variant->sideFactor;
+
+	paula->randSeed = variant->randSeed;
+	paula->fPrngStateL = variant->fPrngStateL;
+	paula->fPrngStateR = variant->fPrngStateR;
+	paula->prngStateL = variant->prngStateL;
+	paula->prngStateR = variant->prngStateR;
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		paula->stemRandSeed[i] = variant->stemRandSeed[i];
+		paula->fStemPrngState[i] = variant->fStemPrngState[i];
+		paula->stemPrngState[i] = variant->stemPrngState[i];
+	}
+}
+
+static void swapMixVariant(paula_t *paula, paulaMixVariant_t *variant)
+{
+	paulaMixVariant_t current;
+
+	getMixVariant(paula, &current);
+	setMixVariant(paula, variant);
+	*variant = current;
+}
+
+void paulaInitMixVariant(paula_t *paula, paulaMixVariant_t *variant, int32_t masterVol, int32_t stereoSeparation)
+{
+	paulaMixVariant_t current;
+
+	// 8bb: use the same setters as the main mix, so that the variant gets the exact same factors
+	getMixVariant(paula, &current);
+	paulaSetMasterVolume(paula, masterVol);
+	paulaSetStereoSeparation(paula, stereoSeparation);
+	resetAudioDithering(paula);
+	getMixVariant(paula, variant);
+	setMixVariant(paula, &current);
+}
+
+void paulaMixSamplesVariants(paula_t *paula, void *output, paulaMixVariant_t *variants, void *const *variantOutput,
+	int32_t numVariants, uint32_t numSamples)
+{
+	generateMixBlock(paula, false, numSamples);
+	postMixSamples(paula, output, NULL, numSamples);
+
+	for (int32_t i = 0; i < numVariants; i++)
+	{
+		if (variantOutput[i] == NULL)
+			continue;
+
+		swapMixVariant(paula, &variants[i]);
+		postMixSamples(paula, variantOutput[i], NULL, numSamples);
+		swapMixVariant(paula, &variants[i]);
+	}
+}
+
+void paulaMixSamplesStems(paula_t *paula, void *output, void *const *stems, uint32_t numSamples)
+{
+	generateMixBlock(paula, stems != NULL, numSamples);
+	postMixSamples(paula, output, stems, numSamples);
+}
+
+void paulaMixSamples(paula_t *paula, void *output, uint32_t numSamples)
+{
+	generateMixBlock(paula, false, numSamples);
+	postMixSamples(paula, output, NULL, numSamples);
+}
+
+static uint64_t getMicroseconds(void) // 8bb: monotonic
+{
+#ifdef _WIN32
+	LARGE_INTEGER now, freq;
+
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+
+	return (uint64_t)((now.QuadPart * 1000000.0) / freq.QuadPart);
+#else
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return ((uint64_t)now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+#endif
+}
+
+static void updateAdaptiveQuality(paula_t *paula, int32_t numSamples, uint64_t usedTime)
+{
+	adaptiveQuality_t *a = &paula->adapt;
+
+	const uint64_t budget = ((uint64_t)numSamples * 1000000) / paula->audio.outputFreq; // microseconds
+
+	a->framesInQuality[a->quality] += numSamples;
+	a->microsecondsInQuality[a->quality] += usedTime;
+
+	if (usedTime > budget)
+		a->overruns++;
+
+	if (usedTime*4 >= budget*3) // 8bb: close to (or past) the deadline
+	{
+		a->lightFrames = 0;
+		if (++a->heavyBlocks >= ADAPT_HEAVY_BLOCKS && a->quality < PAULA_QUALITY_NUM-1)
+		{
+			a->quality++;
+			a->stepDowns++;
+			a->heavyBlocks = 0;
+		}
+	}
+	else if (usedTime*2 < budget) // 8bb: enough headroom for the next better quality
+	{
+		a->heavyBlocks = 0;
+
+		a->lightFrames += numSamples;
+		if (a->lightFrames >= paula->audio.outputFreq*ADAPT_LIGHT_SECONDS && a->quality > paula->audio.quality)
+		{
+			a->quality--;
+			a->stepUps++;
+			a->lightFrames = 0;
+		}
+	}
+	else
+	{
+		a->heavyBlocks = 0;
+		a->lightFrames = 0;
+	}
+}
+
+void paulaTogglePause(paula_t *paula)
+{
+	paula->audio.pause ^= 1;
+}
+
+void paulaOutputSamples(ahxPlayer_t *player, int16_t *stream, int32_t numSamples)
+{
+	paula_t *paula = &player->paula;
+	audio_t *audio = &paula->audio;
+	int16_t *streamOut = (int16_t *)stream;
+
+	processCommandQueue(player); // 8bb: apply ahxPlay()/ahxStop()/etc. from the control thread
+
+	if (audio->pause)
+	{
+		memset(stream, 0, numSamples * audio->channels * sizeof (int16_t));
+		return;
+	}
+
+	const uint64_t startTime = paula->adapt.enabled ? getMicroseconds() : 0;
+
+	int32_t samplesLeft = numSamples;
+	while (samplesLeft > 0)
+	{
+		const int32_t samplesToMix = runReplayerBlock(player, samplesLeft, false); // 8bb: one or more replayer ticks
+
+		paulaMixSamples(paula, streamOut, samplesToMix);
+		streamOut += samplesToMix * audio->channels;
+
+		samplesLeft -= samplesToMix;
+	}
+
+	if (paula->adapt.enabled)
+		updateAdaptiveQuality(paula, numSamples, getMicroseconds() - startTime);
+}
+
+int32_t paulaGetOutputChannels(ahxPlayer_t *player)
+{
+	return player->paula.audio.channels;
+}
+
+void paulaSetOutputFormat(paula_t *paula, int32_t format)
+{
+	paula->audio.format = CLAMP(format, PAULA_FORMAT_S16, PAULA_FORMAT_F32);
+}
+
+int32_t paulaGetBytesPerSample(const paula_t *paula)
+{
+	static const int32_t bytesPerSample[3] = { 2, 3, 4 }; // 8bb: PAULA_FORMAT_S16/S24/F32
+	return bytesPerSample[paula->audio.format];
+}
+
+int32_t paulaGetBytesPerFrame(const paula_t *paula)
+{
+	return paula->audio.channels * paulaGetBytesPerSample(paula);
+}
+
+void paulaSetStereoSeparation(paula_t *paula, int32_t percentage) // 0..100 (percentage)
+{
+	paula->audio.stereoSeparation = CLAMP(percentage, 0, 100);
+	paula->fSideFactor = (paula->audio.stereoSeparation / 100.0f) * STEREO_NORM_FACTOR;
+	paula->sideFactor = (paula->audio.stereoSeparation * 65536) / 100; // 8bb: fixed-point mixer (0.16, without the normalization)
+}
+
+void paulaSetChannels(paula_t *paula, int32_t channels)
+{
+	if (channels != 1 && channels != 4)
+		channels = 2;
+
+	paula->audio.channels = channels;
+}
+
+void paulaSetQuality(paula_t *paula, int32_t quality)
+{
+	paula->audio.quality = CLAMP(quality, PAULA_QUALITY_BLEP, PAULA_QUALITY_NO_BLEP);
+	paula->adapt.quality = paula->audio.quality; // 8bb: adaptive quality starts over from here
+}
+
+void paulaSetAdaptiveQuality(paula_t *paula, bool enabled)
+{
+	adaptiveQuality_t *a = &paula->adapt;
+
+	a->quality = paula->audio.quality;
+	a->heavyBlocks = a->lightFrames = 0;
+	a->enabled = enabled;
+}
+
+void paulaSetVoiceMask(paula_t *paula, int32_t mask)
+{
+	paula->audio.disabledVoices = ~mask & ((1 << PAULA_VOICES) - 1);
+}
+
+/* 8bb: The two mixers share the DMA state and the stored registers, but each one only advances its own
+** phases, deltas, sample point and BLEP buffer (the SIMD float mixer doesn't refetch the fixed-point delta).
+** So these are converted over to the other mixer when switching. A delta that is the stored one is taken
+** from there. Sample points are -128..127 * 0..64 in both (scaled by 1/8192 in float), so they convert
+** exactly, the phases and the BLEP buffer are rounded.
+*/
+static uint32_t phaseToFixed(float fPhase) // 8bb: 0.0f .. <1.0f -> 0.32
+{
+	const double dPhase = fPhase * 4294967296.0;
+	return (dPhase >= 4294967295.0) ? UINT32_MAX : (uint32_t)dPhase;
+}
+
+static float phaseToFloat(uint32_t phase) // 8bb: 0.32 -> 0.0f .. <1.0f (24-bit precision)
+{
+	return (float)(phase >> 8) * (1.0f / 16777216.0f);
+}
+
+static void convertVoicesToFixed(paula_t *paula)
+{
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		paulaVoice_t *v = &paula->voice[i];
+		blep_t *b = &paula->blep[i];
+
+		v->phase = phaseToFixed(v->fPhase);
+		v->delta = (v->fDelta == v->fStoredDelta) ? v->storedDelta : phaseToFixed(v->fDelta);
+		v->blepPhase = phaseToFixed(v->fBlepPhase);
+		v->blepDelta = (v->fBlepDelta == v->fStoredDelta) ? v->storedDelta : phaseToFixed(v->fBlepDelta);
+		v->sample = (int32_t)(v->fSample * (128.0f * 64.0f));
+
+		b->lastValue = (int32_t)(b->fLastValue * (128.0f * 64.0f));
+		for (int32_t n = 0; n < (BLEP_RNS+1)*2; n++)
+			b->buffer[n] = (int32_t)floor((b->fBuffer[n] * (128.0 * 64.0 * 256.0)) + 0.5); // 24.8
+	}
+}
+
+static void convertVoicesToFloat(paula_t *paula)
+{
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		paulaVoice_t *v = &paula->voice[i];
+		blep_t *b = &paula->blep[i];
+
+		v->fPhase = phaseToFloat(v->phase);
+		v->fDelta = (v->delta == v->storedDelta) ? v->fStoredDelta : phaseToFloat(v->delta);
+		v->fBlepPhase = phaseToFloat(v->blepPhase);
+		v->fBlepDelta = (v->blepDelta == v->storedDelta) ? v->fStoredDelta : phaseToFloat(v->blepDelta);
+		v->fSample = v->sample * (1.0f / (128.0f * 64.0f));
+
+		b->fLastValue = b->lastValue * (1.0f / (128.0f * 64.0f));
+		for (int32_t n = 0; n < (BLEP_RNS+1)*2; n++)
+			b->fBuffer[n] = b->buffer[n] * (1.0f / (128.0f * 64.0f * 256.0f));
+	}
+}
+
+void paulaSetFixedPoint(paula_t *paula, bool enabled)
+{
+	if (enabled == paula->audio.fixedPoint)
+		return;
+
+	// 8bb: the voices carry on from where the other mixer left them (call this between mixed blocks)
+	if (enabled)
+		convertVoicesToFixed(paula);
+	else
+		convertVoicesToFloat(paula);
+
+	paula->audio.fixedPoint = enabled;
+}
+
+int32_t paulaGetCPUSIMD(void)
+{
+#if defined PAULA_AVX && defined _MSC_VER
+	int32_t regs[4];
+
+	__cpuid(regs, 0);
+	if (regs[0] < 7)
+		return PAULA_SIMD_SSE2;
+
+	__cpuid(regs, 1);
+	if (!(regs[2] & (1 << 27))) // 8bb: OSXSAVE, needed for _xgetbv()
+		return PAULA_SIMD_SSE2;
+
+	const uint64_t xcr0 = _xgetbv(0); // 8bb: register states saved by the OS
+	__cpuidex(regs, 7, 0);
+
+	if ((xcr0 & 0xE6) == 0xE6 && (regs[1] & (1 << 16)) && (regs[1] & (1 << 30))) // AVX-512F/BW, ZMM state
+		return PAULA_SIMD_AVX512;
+
+	if ((xcr0 & 0x06) == 0x06 && (regs[1] & (1 << 5))) // AVX2, YMM state
+		return PAULA_SIMD_AVX2;
+
+	return PAULA_SIMD_SSE2;
+#elif defined PAULA_AVX
+	__builtin_cpu_init(); // 8bb: these also check that the OS saves the YMM/ZMM registers
+
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return PAULA_SIMD_AVX512;
+
+	if (__builtin_cpu_supports("avx2"))
+		return PAULA_SIMD_AVX2;
+
+	return PAULA_SIMD_SSE2;
+#elif defined PAULA_SSE2
+	return PAULA_SIMD_SSE2;
+#else
+	return PAULA_SIMD_NONE;
+#endif
+}
+
+int32_t paulaSetSIMD(paula_t *paula, int32_t simd)
+{
+	paula->audio.simd = CLAMP(simd, PAULA_SIMD_NONE, paulaGetCPUSIMD());
+	return paula->audio.simd;
+}
+
+double amigaCIAPeriod2Hz(uint16_t period)
+{
+	if (period == 0)
+		return 0.0;
+
+	return (double)CIA_PAL_CLK / (period+1); // +1, CIA triggers on underflow
+}
+
+bool amigaSetCIAPeriod(paula_t *paula, uint16_t period)
+{
+	const double dCIAHz = amigaCIAPeriod2Hz(period);
+	if (dCIAHz == 0.0)
+		return false;
+
+	const double dSamplesPerTick = paula->audio.outputFreq / dCIAHz;
+
+	double dSamplesPerTickInt, dSamplesPerTickFrac = modf(dSamplesPerTick, &dSamplesPerTickInt);
+
+	paula->audio.samplesPerTickInt = (uint32_t)dSamplesPerTickInt;
+	paula->audio.samplesPerTickFrac = (uint64_t)(dSamplesPerTickFrac * BPM_FRAC_SCALE);
+
+	return true;
+}
+
+bool paulaInit(paula_t *paula, int32_t audioFrequency)
+{
+	paulaClose(paula); // 8bb: also clears all Paula state
+
+	const int32_t minFreq = (int32_t)(PAULA_PAL_CLK / 113.0)+1; // mixer requires single-step deltas
+	paula->audio.outputFreq = CLAMP(audioFrequency, minFreq, 384000);
+
+	// set defaults
+	paula->audio.channels = 2;
+	paulaSetStereoSeparation(paula, 20);
+	paulaSetMasterVolume(paula, 256);
+	setUpBlepTaps(&paula->blepTaps, fMinBlepData, BLEP_NS);
+	setUpBlepTaps(&paula->blepTapsShort, fMinBlepDataShort, BLEP_SHORT_NS);
+	setUpBlepTapsFixed(&paula->blepTapsFixed, fMinBlepData, BLEP_NS);
+	setUpBlepTapsFixed(&paula->blepTapsFixedShort, fMinBlepDataShort, BLEP_SHORT_NS);
+
+	// 8bb: the PAULA_SIMD environment variable (0..3, see PAULA_SIMD_xxx) caps the instruction set, for testing
+	paula->audio.simd = paulaGetCPUSIMD();
+	const char *simdOverride = getenv("PAULA_SIMD");
+	if (simdOverride != NULL)
+		paulaSetSIMD(paula, atoi(simdOverride));
+
+#ifdef PAULA_FIXED_POINT
+	paulaSetFixedPoint(paula, true);
+#endif
+
+	paula->fPeriodToDeltaDiv = (float)((double)PAULA_PAL_CLK / paula->audio.outputFreq);
+
+	int32_t maxSamplesToMix = (int32_t)ceil(paula->audio.outputFreq / amigaCIAPeriod2Hz(AHX_HIGHEST_CIA_PERIOD));
+	if (maxSamplesToMix < PAULA_MIX_BLOCK_FRAMES)
+		maxSamplesToMix = PAULA_MIX_BLOCK_FRAMES; // 8bb: room for several ticks per block (paulaQueueEvents())
+
+	paula->audio.maxBlockFrames = maxSamplesToMix;
+
+	paula->fMixBufferL = (float *)malloc(maxSamplesToMix * sizeof (float));
+	paula->fMixBufferR = (float *)malloc(maxSamplesToMix * sizeof (float));
+	paula->mixBufferL = (int32_t *)malloc(maxSamplesToMix * sizeof (int32_t));
+	paula->mixBufferR = (int32_t *)malloc(maxSamplesToMix * sizeof (int32_t));
+
+	bool stemBuffersOK = true;
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		paula->fVoiceBuffer[i] = (float *)malloc(maxSamplesToMix * sizeof (float));
+		paula->voiceBuffer[i] = (int32_t *)malloc(maxSamplesToMix * sizeof (int32_t));
+		if (paula->fVoiceBuffer[i] == NULL || paula->voiceBuffer[i] == NULL)
+			stemBuffersOK = false;
+	}
+
+	paula->events.event = (paulaEvent_t *)malloc(PAULA_EVENT_QUEUE_LEN * sizeof (paulaEvent_t));
+	paula->events.waveform = (int8_t *)malloc(PAULA_EVENT_WAVEFORMS * (MAX_SAMPLE_LENGTH*2));
+
+	if (paula->fMixBufferL == NULL || paula->fMixBufferR == NULL || paula->mixBufferL == NULL || paula->mixBufferR == NULL ||
+		!stemBuffersOK || paula->events.event == NULL || paula->events.waveform == NULL)
+	{
+		paulaClose(paula);
+		return false;
+	}
+
+	amigaSetCIAPeriod(paula, AHX_DEFAULT_CIA_PERIOD);
+
+	paula->audio.tickSampleCounter = 0; // zero tick sample counter so that it will instantly initiate a tick
+	paula->audio.samplesPerTickFrac = 0;
+
+	resetAudioDithering(paula);
+	return true;
+}
+
+void paulaClose(paula_t *paula)
+{
+	if (paula->fMixBufferL != NULL)
+		free(paula->fMixBufferL);
+
+	if (paula->fMixBufferR != NULL)
+		free(paula->fMixBufferR);
+
+	if (paula->mixBufferL != NULL)
+		free(paula->mixBufferL);
+
+	if (paula->mixBufferR != NULL)
+		free(paula->mixBufferR);
+
+	if (paula->events.event != NULL)
+		free(paula->events.event);
+
+	if (paula->events.waveform != NULL)
+		free(paula->events.waveform);
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+	{
+		if (paula->fVoiceBuffer[i] != NULL)
+			free(paula->fVoiceBuffer[i]);
+
+		if (paula->voiceBuffer[i] != NULL)
+			free(paula->voiceBuffer[i]);
+	}
+
+	memset(paula, 0, sizeof (paula_t));
 }
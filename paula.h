@@ -3,6 +3,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+typedef struct ahxPlayer_t ahxPlayer_t; // replayer.h
+
 // AUDIO DRIVERS
 #if defined AUDIODRIVER_SDL
 #include "audiodrivers/sdl/sdldriver.h"
@@ -24,12 +26,66 @@
 #define CIA_PAL_CLK (AMIGA_PAL_CCK_HZ / 5.0)
 
 #define PAULA_VOICES 4
+#define PAULA_MAX_MIX_VARIANTS 8 // 8bb: per ahxRenderVariants() call
+#define PAULA_MIX_BLOCK_FRAMES 2048 // 8bb: at least this many frames per mixed block (more if a replayer tick is longer)
+#define PAULA_EVENT_QUEUE_LEN 1024
+#define PAULA_EVENT_WAVEFORMS 128 // 8bb: sample data writes (0x280 bytes each) that fit in the event queue
+
+/* aciddose:
+** information on blep variables
+**
+** ZC = zero crossings, the number of ripples in the impulse
+** OS = oversampling, how many samples per zero crossing are taken
+** SP = step size per output sample, used to lower the cutoff (play the impulse slower)
+** NS = number of samples of impulse to insert
+** RNS = the lowest power of two greater than NS, minus one (BLEP buffer window length - 1)
+**
+** ZC and OS are here only for reference, they depend upon the data in the table and can't be changed.
+** SP, the step size can be any number lower or equal to OS, as long as the result NS remains an integer.
+** for example, if ZC=8,OS=5, you can set SP=1, the result is NS=40, and RNS must then be 63.
+** the result of that is the filter cutoff is set at nyquist * (SP/OS), in this case nyquist/5.
+*/
+
+#define BLEP_ZC 16
+#define BLEP_OS 16
+#define BLEP_SP 16
+#define BLEP_NS (BLEP_ZC * BLEP_OS / BLEP_SP)
+#define BLEP_RNS 31 // RNS = (2^ > NS) - 1
+
+#define BLEP_SHORT_ZC 8 // 8bb: for PAULA_QUALITY_SHORT_BLEP
+#define BLEP_SHORT_NS (BLEP_SHORT_ZC * BLEP_OS / BLEP_SP)
+
+enum // 8bb: synthesis quality, see paulaSetQuality()
+{
+	PAULA_QUALITY_BLEP = 0, // 16 zero-crossing BLEP (default)
+	PAULA_QUALITY_SHORT_BLEP = 1, // 8 zero-crossing BLEP, a bit faster
+	PAULA_QUALITY_NO_BLEP = 2, // no band-limiting at all (aliases), fastest
+
+	PAULA_QUALITY_NUM
+};
+
+enum // 8bb: instruction sets for the mixer kernels, see paulaSetSIMD()
+{
+	PAULA_SIMD_NONE = 0, // plain C
+	PAULA_SIMD_SSE2 = 1,
+	PAULA_SIMD_AVX2 = 2,
+	PAULA_SIMD_AVX512 = 3
+};
+
+enum // 8bb: sample formats for paulaMixSamples()/ahxRender(), see paulaSetOutputFormat()
+{
+	PAULA_FORMAT_S16 = 0, // 16-bit, dithered (default)
+	PAULA_FORMAT_S24 = 1, // 24-bit packed (3 bytes, little-endian), rounded, not dithered
+	PAULA_FORMAT_F32 = 2 // 32-bit float, -1.0 .. 1.0 (not clipped), not dithered
+};
 
 typedef struct audio_t
 {
 	volatile bool playing, pause;
-	int32_t outputFreq, masterVol, stereoSeparation;
-	int32_t tickSampleCounter;
+	bool fixedPoint; // 8bb: see paulaSetFixedPoint()
+	int32_t outputFreq, channels, format, masterVol, stereoSeparation, quality, simd;
+	int32_t disabledVoices; // 8bb: bit per voice, see paulaSetVoiceMask()
+	int32_t tickSampleCounter, maxBlockFrames; // 8bb: maxBlockFrames = mix buffer length
 	uint32_t samplesPerTickInt;
 	uint64_t tickSampleCounterFrac, samplesPerTickFrac;
 } audio_t;
@@ -47,32 +103,177 @@ typedef struct voice_t
 	float fSample; // currently held sample point (multiplied by volume)
 	float fDelta, fPhase;
 	float fBlepDelta, fBlepPhase;
+	int32_t sample; // 8bb: fixed-point mixer, -128..127 * 0..64
+	uint32_t delta, phase, blepDelta, blepPhase; // 8bb: fixed-point mixer, 0.32 fraction
 
 	// registers modified by Paula functions
 	const int8_t *storedLocation; // data pointer
 	uint16_t storedLength;
 	float fStoredVol, fStoredDelta;
+	int32_t storedVol; // 8bb: fixed-point mixer
+	uint32_t storedDelta;
 } paulaVoice_t;
 
-void resetAudioDithering(void);
+/* 8bb: The BLEP buffer is linear and twice as long as the window, so that a BLEP can be added
+** at any index without wrapping. When the index reaches the end of the window, the second half
+** is slid down to the start (see blepRun()).
+*/
+typedef struct blep_t
+{
+	int32_t index, samplesLeft;
+	float fBuffer[(BLEP_RNS+1)*2], fLastValue;
+	int32_t buffer[(BLEP_RNS+1)*2], lastValue; // 8bb: fixed-point mixer
+} blep_t;
+
+typedef struct blepTaps_t // 8bb: fMinBlepData split into one row per BLEP phase, for linear interpolation
+{
+	float fTap[BLEP_SP][BLEP_NS], fSlope[BLEP_SP][BLEP_NS];
+} blepTaps_t;
+
+typedef struct blepTapsFixed_t // 8bb: same as blepTaps_t, in 1.15 fixed-point
+{
+	int32_t tap[BLEP_SP][BLEP_NS], slope[BLEP_SP][BLEP_NS];
+} blepTapsFixed_t;
+
+/* 8bb: Register event queue (paulaQueueEvents()). While queueing, the register writes are stored
+** with the frame offset (in the next mixed block) that they happen at, so that the replayer can run
+** several ticks ahead, and one paulaMixSamples() call can mix across tick boundaries.
+** Sample data written to Paula memory goes through a staging buffer (paulaGetDataWriteBuffer()),
+** and is copied in at its offset, like the register writes.
+*/
+enum
+{
+	PAULA_EVENT_DMACON = 0,
+	PAULA_EVENT_PERIOD = 1,
+	PAULA_EVENT_VOLUME = 2,
+	PAULA_EVENT_LENGTH = 3,
+	PAULA_EVENT_DATA = 4,
+	PAULA_EVENT_WAVEFORM = 5 // 8bb: copy a staged waveform to Paula memory
+};
+
+typedef struct paulaEvent_t
+{
+	uint32_t offset; // 8bb: frame in the block
+	uint8_t type, ch;
+	uint16_t value;
+	const int8_t *src; // 8bb: PAULA_EVENT_DATA/PAULA_EVENT_WAVEFORM
+	int8_t *dst; // 8bb: PAULA_EVENT_WAVEFORM
+} paulaEvent_t;
+
+typedef struct paulaEventQueue_t
+{
+	bool queueing;
+	uint32_t offset; // 8bb: frame offset of new events
+	int32_t numEvents, numWaveforms;
+	paulaEvent_t *event; // 8bb: [PAULA_EVENT_QUEUE_LEN], in time order
+	int8_t *waveform; // 8bb: [PAULA_EVENT_WAVEFORMS][0x280]
+} paulaEventQueue_t;
+
+/* 8bb: Adaptive quality (paulaSetAdaptiveQuality()). paulaOutputSamples() times every
+** audio callback against its real-time budget (frames / outputFreq). After a few callbacks
+** in a row that used most of the budget, it steps down to a cheaper quality. It steps back up
+** again (never above audio.quality) after some seconds with enough headroom.
+** The counters are for statistics only, and can be read at any time.
+*/
+typedef struct adaptiveQuality_t
+{
+	bool enabled;
+	int32_t quality; // 8bb: quality in use while enabled
+	int32_t heavyBlocks, lightFrames; // 8bb: consecutive callbacks/frames above/below the thresholds
+
+	uint32_t overruns, stepDowns, stepUps; // 8bb: overruns = callbacks that took longer than their budget
+	uint64_t framesInQuality[PAULA_QUALITY_NUM], microsecondsInQuality[PAULA_QUALITY_NUM];
+} adaptiveQuality_t;
+
+typedef struct paula_t // 8bb: all Paula/mixer state, one per player
+{
+	audio_t audio;
+	adaptiveQuality_t adapt;
+	paulaEventQueue_t events;
+	paulaVoice_t voice[PAULA_VOICES];
+	blep_t blep[PAULA_VOICES];
+	blepTaps_t blepTaps, blepTapsShort;
+	blepTapsFixed_t blepTapsFixed, blepTapsFixedShort;
+
+	uint32_t randSeed;
+	float *fMixBufferL, *fMixBufferR, fPrngStateL, fPrngStateR, fSideFactor, fPeriodToDeltaDiv, fMixNormalize;
+	int32_t *mixBufferL, *mixBufferR, prngStateL, prngStateR, sideFactor, mixNormalize; // 8bb: fixed-point mixer
+
+	// 8bb: stems (paulaMixSamplesStems()), one buffer and dither state per voice
+	uint32_t stemRandSeed[PAULA_VOICES];
+	float *fVoiceBuffer[PAULA_VOICES], fStemPrngState[PAULA_VOICES];
+	int32_t *voiceBuffer[PAULA_VOICES], stemPrngState[PAULA_VOICES]; // 8bb: fixed-point mixer
+} paula_t;
+
+typedef struct paulaMixVariant_t // 8bb: post-mix settings and dither state of one mix variant, see paulaInitMixVariant()
+{
+	int32_t masterVol, stereoSeparation;
+	uint32_t randSeed, stemRandSeed[PAULA_VOICES];
+	float fMixNormalize, fSideFactor, fPrngStateL, fPrngStateR, fStemPrngState[PAULA_VOICES];
+	int32_t mixNormalize, sideFactor, prngStateL, prngStateR, stemPrngState[PAULA_VOICES]; // 8bb: fixed-point mixer
+} paulaMixVariant_t;
+
+void resetAudioDithering(paula_t *paula);
 
 double amigaCIAPeriod2Hz(uint16_t period);
-bool amigaSetCIAPeriod(uint16_t period); // replayer ticker speed
+bool amigaSetCIAPeriod(paula_t *paula, uint16_t period); // replayer ticker speed
+
+bool paulaInit(paula_t *paula, int32_t audioFrequency);
+void paulaClose(paula_t *paula);
+
+void paulaSetMasterVolume(paula_t *paula, int32_t vol);
+void paulaSetStereoSeparation(paula_t *paula, int32_t percentage); // 0..100 (percentage)
+void paulaSetChannels(paula_t *paula, int32_t channels); // 8bb: 1 (mono), 2 (stereo, default) or 4 (one voice per channel), call it after init
+void paulaSetOutputFormat(paula_t *paula, int32_t format); // 8bb: PAULA_FORMAT_xxx, paulaOutputSamples() only supports S16
+int32_t paulaGetBytesPerFrame(const paula_t *paula);
+int32_t paulaGetBytesPerSample(const paula_t *paula); // 8bb: one channel, also the frame size of a stem
+void paulaSetQuality(paula_t *paula, int32_t quality); // PAULA_QUALITY_xxx (f.ex. faster song previews), read once per mixed block
+void paulaSetAdaptiveQuality(paula_t *paula, bool enabled); // 8bb: only affects paulaOutputSamples() (audio device)
+void paulaSetVoiceMask(paula_t *paula, int32_t mask); // 8bb: bit 0..3 = voice 1..4 enabled (default = 15), disabled voices are not mixed
+
+/* 8bb: Integer-only mixer (fixed-point phase, BLEP and dithering), for CPUs without a fast FPU. Its output is bit-exact
+** on every platform and compiler, so renders can be checked by hash. Default if PAULA_FIXED_POINT is defined (CMake option).
+** It can be switched between mixed blocks (not while mixing on another thread), the voices carry on where they are.
+*/
+void paulaSetFixedPoint(paula_t *paula, bool enabled);
+
+/* 8bb: On x86, paulaInit() picks the best SSE2/AVX2/AVX-512 kernels the CPU has, so one portable build runs at full
+** speed on any x86-64 CPU. paulaSetSIMD() or the PAULA_SIMD environment variable (0..3 = PAULA_SIMD_xxx) can force
+** a lower one, f.ex. for testing. All of them give the same output.
+*/
+int32_t paulaGetCPUSIMD(void); // 8bb: best PAULA_SIMD_xxx that this CPU (and build) supports
+int32_t paulaSetSIMD(paula_t *paula, int32_t simd); // 8bb: returns the PAULA_SIMD_xxx in use
 
-bool paulaInit(int32_t audioFrequency);
-void paulaClose(void);
+void paulaTogglePause(paula_t *paula);
+void paulaOutputSamples(ahxPlayer_t *player, int16_t *stream, int32_t numSamples);
+int32_t paulaGetOutputChannels(ahxPlayer_t *player); // 8bb: for the audio drivers, channels per frame in paulaOutputSamples()
+void paulaSetDMACON(paula_t *paula, uint16_t bits);
+void paulaSetPeriod(paula_t *paula, int32_t ch, uint16_t period);
+void paulaSetVolume(paula_t *paula, int32_t ch, uint16_t vol);
+void paulaSetLength(paula_t *paula, int32_t ch, uint16_t len);
+void paulaSetData(paula_t *paula, int32_t ch, const int8_t *src);
 
-void paulaSetMasterVolume(int32_t vol);
-void paulaSetStereoSeparation(int32_t percentage); // 0..100 (percentage)
+/* 8bb: From here on, the register writes above (and paulaGetDataWriteBuffer()) are queued at the frame offset
+** set with paulaSetEventOffset(), until the next paulaMixSamples*() call. That call plays them at their offsets
+** in the block it mixes, and empties the queue. paulaEventQueueHasRoom() tells if one more replayer tick fits.
+*/
+void paulaQueueEvents(paula_t *paula);
+void paulaSetEventOffset(paula_t *paula, uint32_t offset);
+bool paulaEventQueueHasRoom(const paula_t *paula);
+int8_t *paulaGetDataWriteBuffer(paula_t *paula, int8_t *dst); // 8bb: where to write 0x280 bytes of sample data for dst
+void paulaMixSamples(paula_t *paula, void *output, uint32_t numSamples); // 8bb: numSamples frames, see paulaGetBytesPerFrame()
 
-void paulaTogglePause(void);
-void paulaOutputSamples(int16_t *stream, int32_t numSamples);
-void paulaSetDMACON(uint16_t bits);
-void paulaSetPeriod(int32_t ch, uint16_t period);
-void paulaSetVolume(int32_t ch, uint16_t vol);
-void paulaSetLength(int32_t ch, uint16_t len);
-void paulaSetData(int32_t ch, const int8_t *src);
-void paulaMixSamples(int16_t *target, uint32_t numSamples);
+/* 8bb: Same as paulaMixSamples(), but also writes every voice to its own mono buffer (stems[0..3], NULL to skip one),
+** in the same pass. A stem is the voice alone at the level it has in the mix with Amiga panning (100% separation).
+** The stems have their own dither states, so the mix (output, can be NULL) is the same as from paulaMixSamples().
+*/
+void paulaMixSamplesStems(paula_t *paula, void *output, void *const *stems, uint32_t numSamples);
 
-extern audio_t audio; // paula.c
-extern paulaVoice_t paula[PAULA_VOICES]; // paula.c
+/* 8bb: Same as paulaMixSamples(), but the mixed block is also post-mixed once per variant (other master volume and/or
+** stereo separation) into variantOutput[0..numVariants-1] (NULL to skip one), without synthesizing the voices again.
+** Every variant has its own dither state, so its output is the same as from a separate render with its settings.
+** Format and channels are shared. paulaInitMixVariant() sets up a variant (and resets its dithering).
+*/
+void paulaInitMixVariant(paula_t *paula, paulaMixVariant_t *variant, int32_t masterVol, int32_t stereoSeparation);
+void paulaMixSamplesVariants(paula_t *paula, void *output, paulaMixVariant_t *variants, void *const *variantOutput,
+	int32_t numVariants, uint32_t numSamples);
@@ -15,6 +15,26 @@
 #include <math.h> // ceil()
 #include "replayer.h"
 
+// 8bb: for the command queue (the mixer can run on another thread)
+#ifdef _MSC_VER
+#include <intrin.h>
+#define ATOMIC_LOAD32(x) ((uint32_t)_InterlockedOr((volatile long *)(x), 0))
+#define ATOMIC_STORE32(x, v) _InterlockedExchange((volatile long *)(x), (long)(v))
+#else
+#define ATOMIC_LOAD32(x) __atomic_load_n((x), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE32(x, v) __atomic_store_n((x), (v), __ATOMIC_RELEASE)
+#endif
+
+// 8bb: for ahxFree() on the player that owns the audio device (waits for the mixer)
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h> // Sleep()
+#define SLEEP_MS(x) Sleep(x)
+#else
+#include <unistd.h> // usleep()
+#define SLEEP_MS(x) usleep((x) * 1000)
+#endif
+
 static const uint8_t waveOffsets[6] =
 {
 	0x00,0x04,0x04+0x08,0x04+0x08+0x10,0x04+0x08+0x10+0x20,0x04+0x08+0x10+0x20+0x40
@@ -64,39 +84,28 @@ static const int16_t vibTable[64] =
 	-180,-161,-141,-120, -97, -74, -49, -24
 };
 
-// 8bb: globalized
-volatile bool isRecordingToWAV;
-song_t song;
-waveforms_t *waves; // 8bb: dword-aligned from malloc()
-uint8_t ahxErrCode;
-// ------------
-
-// 8bb: loader.c
-bool ahxInitWaves(void);
-void ahxFreeWaves(void);
-// -----------
-
-static void SetUpAudioChannels(void) // 8bb: only call this while mixer is locked!
+static void SetUpAudioChannels(ahxPlayer_t *player) // 8bb: only call this from the mixer (or while it is locked)!
 {
+	song_t *song = &player->song;
 	plyVoiceTemp_t *ch;
 
-	paulaSetDMACON(0); // 8bb: stop all Paula voice DMAs
+	paulaSetDMACON(&player->paula, 0); // 8bb: stop all Paula voice DMAs
 
-	ch = song.pvt;
+	ch = song->pvt;
 	for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
 	{
-		ch->audioPointer = waves->currentVoice[i];
+		ch->audioPointer = player->currentVoice[i];
 
-		paulaSetPeriod(i, 0x88);
-		paulaSetData(i, ch->audioPointer);
-		paulaSetVolume(i, 0);
-		paulaSetLength(i, 0x280 / 2);
+		paulaSetPeriod(&player->paula, i, 0x88);
+		paulaSetData(&player->paula, i, ch->audioPointer);
+		paulaSetVolume(&player->paula, i, 0);
+		paulaSetLength(&player->paula, i, 0x280 / 2);
 	}
 
-	paulaSetDMACON(0x8000 | 15); // 8bb: start all Paula voice DMAs
+	paulaSetDMACON(&player->paula, 0x8000 | 15); // 8bb: start all Paula voice DMAs
 }
 
-static void InitVoiceXTemp(plyVoiceTemp_t *ch) // 8bb: only call this while mixer is locked!
+static void InitVoiceXTemp(plyVoiceTemp_t *ch) // 8bb: only call this from the mixer (or while it is locked)!
 {
 	int8_t *oldAudioPointer = ch->audioPointer;
 
@@ -110,16 +119,16 @@ static void InitVoiceXTemp(plyVoiceTemp_t *ch) // 8bb: only call this while mixe
 	ch->audioPointer = oldAudioPointer;
 }
 
-static void ahxQuietAudios(void)
+static void ahxQuietAudios(paula_t *paula)
 {
 	for (int32_t i = 0; i < PAULA_VOICES; i++)
-		paulaSetVolume(i, 0);
+		paulaSetVolume(paula, i, 0);
 }
 
-static void CopyWaveformToPaulaBuffer(plyVoiceTemp_t *ch) // 8bb: I put this code in an own function
+static void CopyWaveformToPaulaBuffer(paula_t *paula, plyVoiceTemp_t *ch) // 8bb: I put this code in an own function
 {
-	// 8bb: audioPointer and audioSource buffers are dword-aligned, 32-bit access is safe
-	uint32_t *dst32 = (uint32_t *)ch->audioPointer;
+	// 8bb: audioPointer, audioSource and staging buffers are dword-aligned, 32-bit access is safe
+	uint32_t *dst32 = (uint32_t *)paulaGetDataWriteBuffer(paula, ch->audioPointer);
 
 	if (ch->Waveform == 4-1) // 8bb: noise, copy in one go
 	{
@@ -144,33 +153,42 @@ static void CopyWaveformToPaulaBuffer(plyVoiceTemp_t *ch) // 8bb: I put this cod
 	}
 }
 
-static void SetAudio(int32_t chNum, plyVoiceTemp_t *ch)
+static void SetAudio(paula_t *paula, int32_t chNum, plyVoiceTemp_t *ch)
 {
 	// new PERIOD to plant ???
 	if (ch->PlantPeriod)
 	{
-		paulaSetPeriod(chNum, ch->audioPeriod);
+		paulaSetPeriod(paula, chNum, ch->audioPeriod);
 		ch->PlantPeriod = false;
 	}
 
 	// new FILTER or new WAVEFORM ???
 	if (ch->NewWaveform)
 	{
-		CopyWaveformToPaulaBuffer(ch);
+		ch->WaveformPending = true;
 		ch->NewWaveform = false;
 	}
 
-	paulaSetVolume(chNum, ch->audioVolume);
+	// 8bb: a disabled voice isn't mixed, so its waveform is only copied once it's enabled again
+	if (ch->WaveformPending && !(paula->audio.disabledVoices & (1 << chNum)))
+	{
+		CopyWaveformToPaulaBuffer(paula, ch);
+		ch->WaveformPending = false;
+	}
+
+	paulaSetVolume(paula, chNum, ch->audioVolume);
 }
 
-static void ProcessStep(plyVoiceTemp_t *ch)
+static void ProcessStep(ahxPlayer_t *player, plyVoiceTemp_t *ch)
 {
+	const ahxModule_t *module = player->module;
+	song_t *song = &player->song;
 	uint8_t note, instr, cmd, param;
 
 	ch->volumeSlideUp = 0; // means A cmd
 	ch->volumeSlideDown = 0; // means A cmd
 
-	if (ch->Track > song.highestTrack) // 8bb: added this (this is technically what happens in AHX on illegal tracks)
+	if (ch->Track > module->highestTrack) // 8bb: added this (this is technically what happens in AHX on illegal tracks)
 	{
 		note = 0;
 		instr = 0;
@@ -179,7 +197,7 @@ static void ProcessStep(plyVoiceTemp_t *ch)
 	}
 	else
 	{
-		const uint8_t *bytes = &song.TrackTable[((ch->Track << 6) + song.NoteNr) * 3];
+		const uint8_t *bytes = &module->TrackTable[((ch->Track << 6) + song->NoteNr) * 3];
 
 		note = (bytes[0] >> 2) & 0x3F;
 		instr = ((bytes[0] & 3) << 4) | (bytes[1] >> 4);
@@ -195,7 +213,7 @@ static void ProcessStep(plyVoiceTemp_t *ch)
 
 		if (eCmd == 0xC) // Effect  > EC<  -  NoteCut
 		{
-			if (eParam < song.Tempo)
+			if (eParam < song->Tempo)
 			{
 				ch->NoteCutWait = eParam;
 				ch->NoteCutOn = true;
@@ -209,7 +227,7 @@ static void ProcessStep(plyVoiceTemp_t *ch)
 			{
 				ch->NoteDelayOn = false;
 			}
-			else if (eParam < song.Tempo)
+			else if (eParam < song->Tempo)
 			{
 				ch->NoteDelayWait = eParam;
 				if (ch->NoteDelayWait != 0)
@@ -227,7 +245,7 @@ static void ProcessStep(plyVoiceTemp_t *ch)
 		{
 			uint8_t pos = param & 0xF;
 			if (pos <= 9)
-				song.PosJump = (param & 0xF) << 8; // 8bb: yes, this clears the lower byte too!
+				song->PosJump = (param & 0xF) << 8; // 8bb: yes, this clears the lower byte too!
 		}
 	}
 
@@ -235,28 +253,28 @@ static void ProcessStep(plyVoiceTemp_t *ch)
 
 	if (cmd == 0xD) // Effect  > D <  -  Patternbreak
 	{
-		song.PosJump = song.PosNr + 1; // jump to next position (8bb: yes, it clears PosJump hi-byte)
+		song->PosJump = song->PosNr + 1; // jump to next position (8bb: yes, it clears PosJump hi-byte)
 
-		song.PosJumpNote = ((param >> 4) * 10) + (param & 0xF);
-		if (song.PosJumpNote >= song.TrackLength)
-			song.PosJumpNote = 0;
+		song->PosJumpNote = ((param >> 4) * 10) + (param & 0xF);
+		if (song->PosJumpNote >= module->TrackLength)
+			song->PosJumpNote = 0;
 
-		song.PatternBreak = true;
+		song->PatternBreak = true;
 	}
 
 	if (cmd == 0xB) // Effect  > B <  -  Positionjump
 	{
-		song.PosJump = (song.PosJump * 100) + ((param >> 4) * 10) + (param & 0xF);
-		song.PatternBreak = true;
+		song->PosJump = (song->PosJump * 100) + ((param >> 4) * 10) + (param & 0xF);
+		song->PatternBreak = true;
 	}
 
 	if (cmd == 0xF) // Effect  > F <  -  Set Tempo
 	{
-		song.Tempo = param;
+		song->Tempo = param;
 
 		// 8bb: added this for the WAV renderer
-		if (song.Tempo == 0)
-			isRecordingToWAV = false;
+		if (song->Tempo == 0)
+			player->songEnded = true;
 	}
 
 	// Effect  > 5 <  -  Volume Slide + Tone Portamento
@@ -280,9 +298,9 @@ static void ProcessStep(plyVoiceTemp_t *ch)
 		ch->periodSlideLimit = 0;
 
 		// init adsr-envelope
-		instrument_t *ins = song.Instruments[instr-1];
+		const instrument_t *ins = module->Instruments[instr-1];
 		if (ins == NULL) // 8bb: added this (this is technically what happens in AHX on illegal instruments)
-			ins = &song.EmptyInstrument;
+			ins = &module->EmptyInstrument;
 
 		ch->adsr = 0; // adsr starting at vol. 0!
 
@@ -489,7 +507,7 @@ static void ProcessStep(plyVoiceTemp_t *ch)
 				if (p <= 0x40)
 				{
 					// 8bb: set TrackMasterVolume for all channels
-					plyVoiceTemp_t *c = song.pvt;
+					plyVoiceTemp_t *c = song->pvt;
 					for (int32_t i = 0; i < PAULA_VOICES; i++, c++)
 						c->TrackMasterVolume = (uint8_t)p;
 				}
@@ -504,7 +522,7 @@ static void ProcessStep(plyVoiceTemp_t *ch)
 	}
 }
 
-static void pListCommandParse(plyVoiceTemp_t *ch, uint8_t cmd, uint8_t param)
+static void pListCommandParse(const ahxModule_t *module, plyVoiceTemp_t *ch, uint8_t cmd, uint8_t param)
 {
 	if (cmd == 0x0) // 8bb: Init Filter Modulation
 	{
@@ -577,12 +595,12 @@ static void pListCommandParse(plyVoiceTemp_t *ch, uint8_t cmd, uint8_t param)
 
 	else if (cmd == 0x5) // Jump to Step [xx]
 	{
-		instrument_t *ins = ch->Instrument;
+		const instrument_t *ins = ch->Instrument;
 		if (ins == NULL) // 8bb: safety bug-fix...
-			ins = &song.EmptyInstrument;
+			ins = &module->EmptyInstrument;
 
 		// 8bb: 4 bytes before perfList (this is apparently what AHX does...)
-		uint8_t *perfList = ins->perfList - 4;
+		const uint8_t *perfList = ins->perfList - 4;
 
 		/* 8bb: AHX quirk! There's no range check here.
 		** You should have 4*256 perfList bytes for every instrument.
@@ -628,25 +646,28 @@ static void pListCommandParse(plyVoiceTemp_t *ch, uint8_t cmd, uint8_t param)
 	}
 }
 
-static void ProcessFrame(plyVoiceTemp_t *ch)
+static void ProcessFrame(ahxPlayer_t *player, plyVoiceTemp_t *ch)
 {
+	const ahxModule_t *module = player->module;
+	song_t *song = &player->song;
+
 	if (ch->HardCut != 0)
 	{
 		uint8_t track = ch->Track;
 
-		uint16_t noteNr = song.NoteNr + 1; // chk next note!
-		if (noteNr == song.TrackLength)
+		uint16_t noteNr = song->NoteNr + 1; // chk next note!
+		if (noteNr == module->TrackLength)
 		{
 			noteNr = 0; // note 0 from next pos!
 			track = ch->NextTrack;
 		}
 
-		const uint8_t *bytes = &song.TrackTable[((track << 6) + noteNr) * 3];
+		const uint8_t *bytes = &module->TrackTable[((track << 6) + noteNr) * 3];
 
 		uint8_t nextInstr = ((bytes[0] & 3) << 4) | (bytes[1] >> 4);
 		if (nextInstr != 0)
 		{
-			int8_t range = song.Tempo - ch->HardCut; // range 1->7, tempo=6, hc=1, cut at tick 5, right
+			int8_t range = song->Tempo - ch->HardCut; // range 1->7, tempo=6, hc=1, cut at tick 5, right
 			if (range < 0)
 				range = 0; // tempo=2, hc=7, cut at tick 0 (NOW!!)
 
@@ -654,7 +675,7 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 			{
 				ch->NoteCutOn = true;
 				ch->NoteCutWait = range;
-				ch->HardCutReleaseF = 0 - (ch->NoteCutWait - song.Tempo);
+				ch->HardCutReleaseF = 0 - (ch->NoteCutWait - song->Tempo);
 			}
 
 			ch->HardCut = 0;
@@ -668,9 +689,9 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 			ch->NoteCutOn = false;
 			if (ch->HardCutRelease)
 			{
-				instrument_t *ins = ch->Instrument;
+				const instrument_t *ins = ch->Instrument;
 				if (ins == NULL) // 8bb: safety bug-fix...
-					ins = &song.EmptyInstrument;
+					ins = &module->EmptyInstrument;
 
 				ch->rFrames = ch->HardCutReleaseF;
 
@@ -694,14 +715,14 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 	if (ch->NoteDelayOn)
 	{
 		if (ch->NoteDelayWait == 0)
-			ProcessStep(ch);
+			ProcessStep(player, ch);
 		else
 			ch->NoteDelayWait--;
 	}
 
-	instrument_t *ins = ch->Instrument;
+	const instrument_t *ins = ch->Instrument;
 	if (ins == NULL) // 8bb: safety bug-fix...
-		ins = &song.EmptyInstrument;
+		ins = &module->EmptyInstrument;
 
 	if (ch->aFrames != 0)
 	{
@@ -831,8 +852,8 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 
 				ch->periodPerfSlideOn = false;
 
-				pListCommandParse(ch, cmd1, param1); // Check Command 1 in pList
-				pListCommandParse(ch, cmd2, param2); // Check Command 2 in pList
+				pListCommandParse(module, ch, cmd1, param1); // Check Command 1 in pList
+				pListCommandParse(module, ch, cmd2, param2); // Check Command 2 in pList
 
 				// Check Note(Fixed)-Field from pList
 				if (note != 0)
@@ -959,8 +980,10 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 		** to just properly clamp it instead.
 		*/
 		const uint8_t filterPos = CLAMP(ch->filterPos, 1, 63);
+		if (FILTER_LEVEL_BIT(filterPos) & ~player->filterLevelsDone)
+			ahxGenerateFilterLevels(player, FILTER_LEVEL_BIT(filterPos)); // 8bb: wasn't generated yet (see waves.c)
 
-		const int8_t *src8 = (const int8_t *)&waves->squares[((int32_t)filterPos - 32) * WAV_FILTER_LENGTH]; // squares@desired.filter
+		const int8_t *src8 = (const int8_t *)&player->waves->squares[((int32_t)filterPos - 32) * WAV_FILTER_LENGTH]; // squares@desired.filter
 
 		uint8_t whichSquare = ch->squarePos << (5 - ch->Wavelength);
 		if ((int8_t)whichSquare > 0x20)
@@ -975,7 +998,7 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 
 		src8 += whichSquare << 7; // *$80
 
-		song.WaveformTab[2] = ch->SquareTempBuffer;
+		song->WaveformTab[2] = ch->SquareTempBuffer;
 
 		const int32_t delta = (1 << 5) >> ch->Wavelength;
 		const int32_t cycles = (1 << ch->Wavelength) << 2; // 8bb: <<2 since we do bytes not dwords, unlike AHX
@@ -998,7 +1021,7 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 	// Init the final audioPointer
 	if (ch->NewWaveform)
 	{
-		const int8_t *audioSource = song.WaveformTab[ch->Waveform];
+		const int8_t *audioSource = song->WaveformTab[ch->Waveform];
 
 		// Waveform 3 (doesn't need filter add)..
 		if (ch->Waveform != 3-1)
@@ -1010,6 +1033,8 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 			** to just properly clamp it instead.
 			*/
 			const uint8_t filterPos = CLAMP(ch->filterPos, 1, 63);
+			if (FILTER_LEVEL_BIT(filterPos) & ~player->filterLevelsDone)
+				ahxGenerateFilterLevels(player, FILTER_LEVEL_BIT(filterPos)); // 8bb: wasn't generated yet (see waves.c)
 
 			audioSource += ((int32_t)filterPos - 32) * WAV_FILTER_LENGTH;
 		}
@@ -1021,7 +1046,7 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 		// Waveform 4
 		if (ch->Waveform == 4-1)
 		{
-			uint32_t seed = song.WNRandom;
+			uint32_t seed = song->WNRandom;
 
 			audioSource += seed & ((WHITENOISE_LENGTH-0x280) - 1);
 
@@ -1030,7 +1055,7 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 			seed += 782323;
 			seed ^= 0b1001011;
 			seed -= 6735;
-			song.WNRandom = seed;
+			song->WNRandom = seed;
 		}
 
 		ch->audioSource = audioSource;
@@ -1084,31 +1109,33 @@ static void ProcessFrame(plyVoiceTemp_t *ch)
 	ch->audioVolume = (finalVol * ch->TrackMasterVolume) >> 6;
 }
 
-void tickReplayer(void)
+void tickReplayer(ahxPlayer_t *player)
 {
+	const ahxModule_t *module = player->module;
+	song_t *song = &player->song;
 	plyVoiceTemp_t *ch;
 
-	if (!song.intPlaying)
+	if (!song->intPlaying)
 		return;
 
 	// set audioregisters... (8bb: yes, this is done here, NOT last like in WinAHX/AHX.cpp!)
-	ch = song.pvt;
+	ch = song->pvt;
 	for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
-		SetAudio(i, ch);
+		SetAudio(&player->paula, i, ch);
 
-	if (song.StepWaitFrames == 0)
+	if (song->StepWaitFrames == 0)
 	{
-		if (song.GetNewPosition)
+		if (song->GetNewPosition)
 		{
-			uint16_t posNext = song.PosNr + 1;
-			if (posNext == song.LenNr)
+			uint16_t posNext = song->PosNr + 1;
+			if (posNext == module->LenNr)
 				posNext = 0;
 
 			// get Track AND Transpose (8bb: also for next position)
-			uint8_t *posTable = &song.PosTable[song.PosNr << 3];
-			uint8_t *posTableNext = &song.PosTable[posNext << 3];
+			uint8_t *posTable = &module->PosTable[song->PosNr << 3];
+			uint8_t *posTableNext = &module->PosTable[posNext << 3];
 
-			ch = song.pvt;
+			ch = song->pvt;
 			for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
 			{
 				const int32_t offset = i << 1;
@@ -1118,69 +1145,69 @@ void tickReplayer(void)
 				ch->NextTranspose = posTableNext[offset+1];
 			}
 
-			song.GetNewPosition = false; // got new pos.
+			song->GetNewPosition = false; // got new pos.
 		}
 
 		// - new pos or not, now treat STEPs (means 'em notes 'emself)
-		ch = song.pvt;
+		ch = song->pvt;
 		for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
-			ProcessStep(ch);
+			ProcessStep(player, ch);
 
-		song.StepWaitFrames = song.Tempo;
+		song->StepWaitFrames = song->Tempo;
 	}
 
-	ch = song.pvt;
+	ch = song->pvt;
 	for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
-		ProcessFrame(ch);
+		ProcessFrame(player, ch);
 
-	song.StepWaitFrames--;
-	if (song.StepWaitFrames == 0)
+	song->StepWaitFrames--;
+	if (song->StepWaitFrames == 0)
 	{
-		if (!song.PatternBreak)
+		if (!song->PatternBreak)
 		{
-			song.NoteNr++;
-			if (song.NoteNr == song.TrackLength)
+			song->NoteNr++;
+			if (song->NoteNr == module->TrackLength)
 			{
 				// norm. next pos. does just position-jump!
-				song.PosJump = song.PosNr + 1;
-				song.PatternBreak = true;
+				song->PosJump = song->PosNr + 1;
+				song->PatternBreak = true;
 			}
 		}
 
-		if (song.PatternBreak)
+		if (song->PatternBreak)
 		{
-			song.PatternBreak = false;
+			song->PatternBreak = false;
 
-			song.NoteNr = song.PosJumpNote;
-			song.PosJumpNote = 0;
+			song->NoteNr = song->PosJumpNote;
+			song->PosJumpNote = 0;
 
-			song.PosNr = song.PosJump;
-			song.PosJump = 0;
+			song->PosNr = song->PosJump;
+			song->PosJump = 0;
 
-			if (song.PosNr == song.LenNr)
+			if (song->PosNr == module->LenNr)
 			{
-				song.PosNr = song.ResNr;
+				song->PosNr = module->ResNr;
 
 				// 8bb: added this (for WAV rendering)
-				if (song.loopCounter >= song.loopTimes)
-					isRecordingToWAV = false;
+				if (song->loopCounter >= song->loopTimes)
+					player->songEnded = true;
 				else
-					song.loopCounter++;
+					song->loopCounter++;
 			}
 
 			// 8bb: safety bug-fix..
-			if (song.PosNr >= song.LenNr)
+			if (song->PosNr >= module->LenNr)
 			{
-				song.PosNr = 0;
+				song->PosNr = 0;
 
 				// 8bb: added this (for WAV rendering)
-				if (song.loopCounter >= song.loopTimes)
-					isRecordingToWAV = false; // 8bb: stop WAV recording
+				if (song->loopCounter >= song->loopTimes)
+					player->songEnded = true; // 8bb: stop WAV recording
 				else
-					song.loopCounter++;
+					song->loopCounter++;
 			}
 
-			song.GetNewPosition = true;
+			song->GetNewPosition = true;
 		}
 	}
 }
@@ -1189,169 +1216,501 @@ void tickReplayer(void)
  *        PLAYER INTERFACING ROUTINES                                      *
  ***************************************************************************/
 
-void ahxNextPattern(void)
+static bool pushCommand(ahxPlayer_t *player, uint8_t type, int32_t param) // 8bb: control thread only
+{
+	ahxCmdQueue_t *q = &player->cmdQueue;
+
+	const uint32_t writePos = q->writePos; // 8bb: only written by the control thread
+	if (writePos-ATOMIC_LOAD32(&q->readPos) >= AHX_CMD_QUEUE_SIZE)
+		return false; // 8bb: queue is full (the mixer is not running?)
+
+	ahxCommand_t *cmd = &q->cmd[writePos & (AHX_CMD_QUEUE_SIZE-1)];
+	cmd->type = type;
+	cmd->param = param;
+
+	ATOMIC_STORE32(&q->writePos, writePos+1); // 8bb: publish command to the mixer
+	return true;
+}
+
+static void doNextPattern(ahxPlayer_t *player)
 {
-	lockMixer();
+	const ahxModule_t *module = player->module;
+	song_t *song = &player->song;
+	audio_t *audio = &player->paula.audio;
+
+	if (module == NULL)
+		return;
 
-	if (song.PosNr+1 < song.LenNr)
+	if (song->PosNr+1 < module->LenNr)
 	{
-		song.PosJump = song.PosNr + 1;
-		song.PatternBreak = true;
+		song->PosJump = song->PosNr + 1;
+		song->PatternBreak = true;
 
-		audio.tickSampleCounter = 0; // 8bb: zero tick sample counter so that it will instantly initiate a tick
-		audio.tickSampleCounterFrac = 0;
+		audio->tickSampleCounter = 0; // 8bb: zero tick sample counter so that it will instantly initiate a tick
+		audio->tickSampleCounterFrac = 0;
 	}
-
-	unlockMixer();
 }
 
-void ahxPrevPattern(void)
+static void doPrevPattern(ahxPlayer_t *player)
 {
-	lockMixer();
+	song_t *song = &player->song;
+	audio_t *audio = &player->paula.audio;
 
-	if (song.PosNr > 0)
+	if (song->PosNr > 0)
 	{
-		song.PosJump = song.PosNr - 1;
-		song.PatternBreak = true;
+		song->PosJump = song->PosNr - 1;
+		song->PatternBreak = true;
 
-		audio.tickSampleCounter = 0; // 8bb: zero tick sample counter so that it will instantly initiate a tick
-		audio.tickSampleCounterFrac = 0;
+		audio->tickSampleCounter = 0; // 8bb: zero tick sample counter so that it will instantly initiate a tick
+		audio->tickSampleCounterFrac = 0;
 	}
+}
+
+void ahxNextPattern(ahxPlayer_t *player)
+{
+	if (player->module != NULL)
+		pushCommand(player, CMD_NEXT_PATTERN, 0);
+}
+
+void ahxPrevPattern(ahxPlayer_t *player)
+{
+	if (player->module != NULL)
+		pushCommand(player, CMD_PREV_PATTERN, 0);
+}
+
+ahxPlayer_t *ahxCreatePlayer(void)
+{
+	// 8bb: calloc is needed here, all player state has to start out zeroed
+	return (ahxPlayer_t *)calloc(1, sizeof (ahxPlayer_t));
+}
+
+void ahxDestroyPlayer(ahxPlayer_t *player) // 8bb: call ahxClose() first if this player owns the audio device
+{
+	if (player == NULL)
+		return;
+
+	ahxFree(player);
+	paulaClose(&player->paula);
+	ahxFreeWaves(player);
 
-	unlockMixer();
+	free(player);
 }
 
 // 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
-bool ahxInit(int32_t audioFreq, int32_t audioBufferSize, int32_t masterVol, int32_t stereoSeparation)
+bool ahxInitRender(ahxPlayer_t *player, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation)
 {
-	ahxErrCode = ERR_SUCCESS;
+	player->errCode = ERR_SUCCESS;
 
-	if (!ahxInitWaves())
+	if (!ahxInitWaves(player))
 	{
-		ahxErrCode = ERR_OUT_OF_MEMORY;
+		player->errCode = ERR_OUT_OF_MEMORY;
 		return false;
 	}
 
-	if (!paulaInit(audioFreq))
+	if (!paulaInit(&player->paula, audioFreq))
+	{
+		paulaClose(&player->paula);
+		ahxFreeWaves(player);
+		player->errCode = ERR_OUT_OF_MEMORY;
+		return false;
+	}
+
+	paulaSetStereoSeparation(&player->paula, stereoSeparation);
+	paulaSetMasterVolume(&player->paula, masterVol);
+	paulaSetChannels(&player->paula, player->outputChannels);
+	paulaSetOutputFormat(&player->paula, player->outputFormat);
+	paulaSetVoiceMask(&player->paula, ~player->disabledVoices);
+
+	return true;
+}
+
+bool ahxSetOutputChannels(ahxPlayer_t *player, int32_t channels)
+{
+	channels = (channels == 1 || channels == 4) ? channels : 2;
+
+	// 8bb: the driver's stream has the frame size of the channel count it was opened with
+	if (player->ownsAudioDevice)
+	{
+		if (channels == player->paula.audio.channels)
+			return true;
+
+		player->errCode = ERR_DEVICE_IN_USE;
+		return false;
+	}
+
+	player->outputChannels = channels;
+
+	if (player->paula.fMixBufferL != NULL) // 8bb: already initialized (render player)
+		paulaSetChannels(&player->paula, player->outputChannels);
+
+	return true;
+}
+
+bool ahxSetOutputFormat(ahxPlayer_t *player, int32_t format)
+{
+	format = CLAMP(format, PAULA_FORMAT_S16, PAULA_FORMAT_F32);
+
+	// 8bb: the audio drivers are 16-bit
+	if (player->ownsAudioDevice)
+	{
+		if (format == PAULA_FORMAT_S16)
+			return true;
+
+		player->errCode = ERR_DEVICE_IN_USE;
+		return false;
+	}
+
+	player->outputFormat = format;
+
+	if (player->paula.fMixBufferL != NULL) // 8bb: already initialized (render player)
+		paulaSetOutputFormat(&player->paula, player->outputFormat);
+
+	return true;
+}
+
+bool ahxSetVoiceMask(ahxPlayer_t *player, int32_t mask)
+{
+	// 8bb: the audio device's mixer reads the mask while mixing, so let it take the new one between blocks
+	if (player->ownsAudioDevice && !pushCommand(player, CMD_SET_VOICE_MASK, mask))
 	{
-		paulaClose();
-		ahxFreeWaves();
-		ahxErrCode = ERR_OUT_OF_MEMORY;
+		player->errCode = ERR_CMD_QUEUE_FULL;
 		return false;
 	}
 
-	paulaSetStereoSeparation(stereoSeparation);
-	paulaSetMasterVolume(masterVol);
+	player->disabledVoices = ~mask & ((1 << PAULA_VOICES) - 1); // 8bb: 0 (the calloc default) = all voices enabled
+
+	if (!player->ownsAudioDevice && player->paula.fMixBufferL != NULL) // 8bb: already initialized (render player)
+		paulaSetVoiceMask(&player->paula, mask);
+
+	return true;
+}
+
+void ahxCloseRender(ahxPlayer_t *player)
+{
+	paulaClose(&player->paula);
+	ahxFreeWaves(player);
+}
+
+// 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
+bool ahxInit(ahxPlayer_t *player, int32_t audioFreq, int32_t audioBufferSize, int32_t masterVol, int32_t stereoSeparation)
+{
+	if (!ahxInitRender(player, audioFreq, masterVol, stereoSeparation)) // 8bb: modifies error code
+		return false;
 
-	if (!openMixer(audioFreq, audioBufferSize))
+	paulaSetOutputFormat(&player->paula, PAULA_FORMAT_S16); // 8bb: the audio drivers are 16-bit
+
+	if (!openMixer(audioFreq, audioBufferSize, player))
 	{
 		closeMixer();
-		paulaClose();
-		ahxFreeWaves();
-		ahxErrCode = ERR_AUDIO_DEVICE;
+		ahxCloseRender(player);
+		player->errCode = ERR_AUDIO_DEVICE;
 		return false;
 	}
 
+	player->ownsAudioDevice = true;
 	return true;
 }
 
-void ahxClose(void)
+void ahxClose(ahxPlayer_t *player)
 {
 	closeMixer();
-	paulaClose();
-	ahxFreeWaves();
+	player->ownsAudioDevice = false;
+	ahxCloseRender(player);
 }
 
-bool ahxPlay(int32_t subSong)
+int32_t runReplayerBlock(ahxPlayer_t *player, int32_t maxFrames, bool stopAtSongEnd)
 {
-	ahxErrCode = ERR_SUCCESS;
+	paula_t *paula = &player->paula;
+	audio_t *audio = &paula->audio;
+
+	if (maxFrames > audio->maxBlockFrames)
+		maxFrames = audio->maxBlockFrames;
 
-	if (!song.songLoaded)
+	paulaQueueEvents(paula);
+
+	int32_t blockFrames = 0;
+	while (blockFrames < maxFrames)
 	{
-		ahxErrCode = ERR_SONG_NOT_LOADED;
-		return false;
+		if (audio->tickSampleCounter <= 0) // 8bb: new replayer tick
+		{
+			if (stopAtSongEnd && player->songEnded)
+				break;
+
+			if (!paulaEventQueueHasRoom(paula))
+				break; // 8bb: mix what we have, the rest goes in the next block
+
+			paulaSetEventOffset(paula, blockFrames);
+			tickReplayer(player);
+
+			audio->tickSampleCounter = audio->samplesPerTickInt;
+
+			audio->tickSampleCounterFrac += audio->samplesPerTickFrac;
+			if (audio->tickSampleCounterFrac >= BPM_FRAC_SCALE)
+			{
+				audio->tickSampleCounterFrac &= BPM_FRAC_MASK;
+				audio->tickSampleCounter++;
+			}
+		}
+
+		int32_t samplesToMix = maxFrames - blockFrames;
+		if (audio->tickSampleCounter > 0 && samplesToMix > audio->tickSampleCounter)
+			samplesToMix = audio->tickSampleCounter;
+
+		blockFrames += samplesToMix;
+		audio->tickSampleCounter -= samplesToMix;
 	}
 
-	if (waves == NULL)
+	return blockFrames;
+}
+
+static int32_t renderFrames(ahxPlayer_t *player, void *out, void *const *stems, paulaMixVariant_t *variants,
+	void *const *variantOut, int32_t numVariants, int32_t frames, bool *songEnded)
+{
+	audio_t *audio = &player->paula.audio;
+	const int32_t bytesPerFrame = paulaGetBytesPerFrame(&player->paula);
+	const int32_t bytesPerSample = paulaGetBytesPerSample(&player->paula); // 8bb: stems are mono
+	uint8_t *outBytes = (uint8_t *)out;
+	void *stemOut[PAULA_VOICES], *mixVariantOut[PAULA_MAX_MIX_VARIANTS];
+
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		stemOut[i] = (stems != NULL) ? stems[i] : NULL;
+
+	for (int32_t i = 0; i < numVariants; i++)
+		mixVariantOut[i] = variantOut[i];
+
+	processCommandQueue(player);
+
+	int32_t framesLeft = frames;
+	while (framesLeft > 0)
 	{
-		ahxErrCode = ERR_NO_WAVES;
-		return false; // 8bb: waves not set up!
+		const int32_t samplesToMix = runReplayerBlock(player, framesLeft, true);
+		if (samplesToMix == 0)
+			break; // 8bb: the tick that ended the song has been fully rendered
+
+		if (numVariants > 0)
+			paulaMixSamplesVariants(&player->paula, outBytes, variants, mixVariantOut, numVariants, samplesToMix);
+		else
+			paulaMixSamplesStems(&player->paula, outBytes, (stems != NULL) ? stemOut : NULL, samplesToMix);
+
+		if (outBytes != NULL)
+			outBytes += samplesToMix * bytesPerFrame;
+
+		for (int32_t i = 0; i < PAULA_VOICES; i++)
+		{
+			if (stemOut[i] != NULL)
+				stemOut[i] = (uint8_t *)stemOut[i] + (samplesToMix * bytesPerSample);
+		}
+
+		for (int32_t i = 0; i < numVariants; i++)
+		{
+			if (mixVariantOut[i] != NULL)
+				mixVariantOut[i] = (uint8_t *)mixVariantOut[i] + (samplesToMix * bytesPerFrame);
+		}
+
+		framesLeft -= samplesToMix;
 	}
 
-	lockMixer();
+	if (songEnded != NULL)
+		*songEnded = player->songEnded && audio->tickSampleCounter <= 0;
+
+	return frames - framesLeft;
+}
+
+int32_t ahxRenderStems(ahxPlayer_t *player, void *out, void *const *stems, int32_t frames, bool *songEnded)
+{
+	return renderFrames(player, out, stems, NULL, NULL, 0, frames, songEnded);
+}
+
+int32_t ahxRenderVariants(ahxPlayer_t *player, void *out, paulaMixVariant_t *variants, void *const *variantOut,
+	int32_t numVariants, int32_t frames, bool *songEnded)
+{
+	if (numVariants < 0 || numVariants > PAULA_MAX_MIX_VARIANTS)
+		return 0;
+
+	return renderFrames(player, out, NULL, variants, variantOut, numVariants, frames, songEnded);
+}
+
+int32_t ahxRender(ahxPlayer_t *player, void *out, int32_t frames, bool *songEnded)
+{
+	return renderFrames(player, out, NULL, NULL, NULL, 0, frames, songEnded);
+}
+
+static void doPlay(ahxPlayer_t *player, int32_t subSong)
+{
+	const ahxModule_t *module = player->module;
+	song_t *song = &player->song;
+	audio_t *audio = &player->paula.audio;
+
+	if (module == NULL || player->waves == NULL)
+		return; // 8bb: checked in ahxPlay(), but the song could've been free'd since
 
-	song.Subsong = 0;
-	song.PosNr = 0;
-	if (subSong > 0 && song.Subsongs > 0)
+	song->Subsong = 0;
+	song->PosNr = 0;
+	if (subSong > 0 && module->Subsongs > 0)
 	{
 		subSong--;
-		if (subSong >= song.Subsongs)
-			subSong = song.Subsongs-1;
+		if (subSong >= module->Subsongs)
+			subSong = module->Subsongs-1;
 
-		song.Subsong = (uint8_t)(subSong + 1);
-		song.PosNr = song.SubSongTable[subSong];
+		song->Subsong = (uint8_t)(subSong + 1);
+		song->PosNr = module->SubSongTable[subSong];
 	}
 
-	song.StepWaitFrames = 0;
-	song.GetNewPosition = true;
-	song.NoteNr = 0;
+	song->StepWaitFrames = 0;
+	song->GetNewPosition = true;
+	song->NoteNr = 0;
 
-	ahxQuietAudios();
+	ahxQuietAudios(&player->paula);
 
 	for (int32_t i = 0; i < PAULA_VOICES; i++)
-		InitVoiceXTemp(&song.pvt[i]);
+		InitVoiceXTemp(&song->pvt[i]);
 
-	SetUpAudioChannels();
-	amigaSetCIAPeriod(song.SongCIAPeriod);
+	SetUpAudioChannels(player);
+	amigaSetCIAPeriod(&player->paula, module->SongCIAPeriod);
 
-	// 8bb: Added this. Clear custom data (these are put in the waves struct for dword-alignment)
-	memset(waves->SquareTempBuffer, 0, sizeof (waves->SquareTempBuffer));
-	memset(waves->currentVoice,     0, sizeof (waves->currentVoice));
+	// 8bb: Added this. Clear custom data
+	memset(player->SquareTempBuffer, 0, sizeof (player->SquareTempBuffer));
+	memset(player->currentVoice,     0, sizeof (player->currentVoice));
 
-	plyVoiceTemp_t *ch = song.pvt;
+	plyVoiceTemp_t *ch = song->pvt;
 	for (int32_t i = 0; i < PAULA_VOICES; i++, ch++)
-		ch->SquareTempBuffer = waves->SquareTempBuffer[i];
+		ch->SquareTempBuffer = player->SquareTempBuffer[i];
+
+	// 8bb: set up waveform pointers (Note: song->WaveformTab[2] gets initialized in ProcessFrame()!)
+	song->WaveformTab[0] = player->waves->triangle04;
+	song->WaveformTab[1] = player->waves->sawtooth04;
+	song->WaveformTab[3] = player->waves->whiteNoiseBig;
+
+	song->PosJump = false;
+	song->Tempo = 6;
+	song->intPlaying = true;
+
+	song->loopCounter = 0; // 8bb: song->loopTimes is set by the WAV renderer (and is kept)
+	player->songEnded = false;
 
-	song.PosJump = false;
-	song.Tempo = 6;
-	song.intPlaying = true;
+	audio->tickSampleCounter = 0; // 8bb: zero tick sample counter so that it will instantly initiate a tick
+	audio->tickSampleCounterFrac = 0;
 
-	song.loopCounter = 0;
-	song.loopTimes = 0; // 8bb: updated later in WAV writing mode
+	resetAudioDithering(&player->paula);
 
-	audio.tickSampleCounter = 0; // 8bb: zero tick sample counter so that it will instantly initiate a tick
-	audio.tickSampleCounterFrac = 0;
+	song->dBPM = amigaCIAPeriod2Hz(module->SongCIAPeriod) * 2.5;
+
+	song->WNRandom = 0; // 8bb: Clear RNG seed (AHX doesn't do this)
+}
+
+static void doStop(ahxPlayer_t *player)
+{
+	song_t *song = &player->song;
 
-	resetAudioDithering();
+	song->intPlaying = false;
+	ahxQuietAudios(&player->paula);
 
-	song.dBPM = amigaCIAPeriod2Hz(song.SongCIAPeriod) * 2.5;
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		InitVoiceXTemp(&song->pvt[i]);
+}
 
-	song.WNRandom = 0; // 8bb: Clear RNG seed (AHX doesn't do this)
+static void doFree(ahxPlayer_t *player) // 8bb: see detachModule()
+{
+	doStop(player);
+	paulaSetDMACON(&player->paula, 0); // 8bb: stop all Paula voice DMAs
+	memset(&player->song, 0, sizeof (song_t));
+	player->module = NULL;
+}
 
-	unlockMixer();
+bool ahxPlay(ahxPlayer_t *player, int32_t subSong)
+{
+	player->errCode = ERR_SUCCESS;
+
+	if (player->module == NULL)
+	{
+		player->errCode = ERR_SONG_NOT_LOADED;
+		return false;
+	}
+
+	if (player->waves == NULL)
+	{
+		player->errCode = ERR_NO_WAVES;
+		return false; // 8bb: waves not set up!
+	}
+
+	if (!pushCommand(player, CMD_PLAY, subSong))
+	{
+		player->errCode = ERR_CMD_QUEUE_FULL;
+		return false;
+	}
 
 	return true;
 }
 
-void ahxStop(void)
+void ahxStop(ahxPlayer_t *player)
 {
-	lockMixer();
+	pushCommand(player, CMD_STOP, 0);
+}
 
-	song.intPlaying = false;
-	ahxQuietAudios();
+void processCommandQueue(ahxPlayer_t *player) // 8bb: mixer only, call before mixing a block
+{
+	ahxCmdQueue_t *q = &player->cmdQueue;
 
-	for (int32_t i = 0; i < PAULA_VOICES; i++)
-		InitVoiceXTemp(&song.pvt[i]);
+	const uint32_t writePos = ATOMIC_LOAD32(&q->writePos);
 
-	unlockMixer();
+	uint32_t readPos = q->readPos; // 8bb: only written by the mixer (or with the mixer locked)
+	while (readPos != writePos)
+	{
+		const ahxCommand_t *cmd = &q->cmd[readPos & (AHX_CMD_QUEUE_SIZE-1)];
+		switch (cmd->type)
+		{
+			case CMD_PLAY: doPlay(player, cmd->param); break;
+			case CMD_STOP: doStop(player); break;
+			case CMD_NEXT_PATTERN: doNextPattern(player); break;
+			case CMD_PREV_PATTERN: doPrevPattern(player); break;
+			case CMD_FREE: doFree(player); break;
+			case CMD_SET_VOICE_MASK: paulaSetVoiceMask(&player->paula, cmd->param); break;
+			default: break;
+		}
+
+		readPos++;
+	}
+
+	ATOMIC_STORE32(&q->readPos, readPos); // 8bb: give the slots back to the control thread
+}
+
+void detachModule(ahxPlayer_t *player) // 8bb: control thread only
+{
+	ahxCmdQueue_t *q = &player->cmdQueue;
+
+	if (!player->ownsAudioDevice)
+	{
+		// 8bb: no mixer runs on another thread for this player, so it can be done right here
+		ATOMIC_STORE32(&q->readPos, q->writePos); // 8bb: drop queued commands, they could refer to the old song
+		doFree(player);
+		return;
+	}
+
+	/* 8bb: The audio device's mixer is using the song, so let the mixer drop it (in order with the
+	** other queued commands), and wait until it has. The mixer itself never waits on this thread.
+	*/
+	while (!pushCommand(player, CMD_FREE, 0))
+		SLEEP_MS(1);
+
+	while (ATOMIC_LOAD32(&q->readPos) != q->writePos)
+		SLEEP_MS(1);
 }
 
 /***************************************************************************
  *        WAV DUMPING ROUTINES                                             *
  ***************************************************************************/
 
-static void writeWAVHeader(FILE *f, int32_t audioFrequency)
+/* 8bb: Float WAVs (WAVE_FORMAT_IEEE_FLOAT) need the cbSize field and a "fact" chunk.
+** More than two channels are written as WAVE_FORMAT_EXTENSIBLE (the sample format is then in the SubFormat GUID).
+*/
+#define WAV_FMT_SIZE(fmt, ch) (((ch) > 2) ? 40 : (((fmt) == PAULA_FORMAT_F32) ? 18 : 16))
+#define WAV_FACT_SIZE(fmt) (((fmt) == PAULA_FORMAT_F32) ? 12 : 0)
+#define WAV_SPEAKER_QUAD 0x33 /* 8bb: front left/right, back left/right (same layout as SDL's 4 channels) */
+
+static void writeWAVHeader(FILE *f, const paula_t *paula, int32_t channels) // 8bb: channels = 1 for stems
 {
+	const int32_t format = paula->audio.format;
+	const int32_t bytesPerFrame = channels * paulaGetBytesPerSample(paula);
 	uint16_t w;
 	uint32_t l;
 
@@ -1363,17 +1722,45 @@ static void writeWAVHeader(FILE *f, int32_t audioFrequency)
 	const uint32_t WAVE = 0x45564157; // "WAVE"
 	fwrite(&WAVE, 4, 1, f);
 
-	// 24 bytes
+	// 24 bytes (26 for float, 48 for more than two channels)
+
+	const uint16_t formatTag = (format == PAULA_FORMAT_F32) ? 3 : 1; // 8bb: WAVE_FORMAT_IEEE_FLOAT / WAVE_FORMAT_PCM
 
 	const uint32_t fmt = 0x20746D66; // " fmt"
 	fwrite(&fmt, 4, 1, f);
-	l = 16; fwrite(&l, 4, 1, f);
-	w = 1; fwrite(&w, 2, 1, f);
-	w = 2; fwrite(&w, 2, 1, f);
-	l = audioFrequency; fwrite(&l, 4, 1, f);
-	l = audioFrequency*2*2; fwrite(&l, 4, 1, f);
-	w = 2*2; fwrite(&w, 2, 1, f);
-	w = 8*2; fwrite(&w, 2, 1, f);
+	l = WAV_FMT_SIZE(format, channels); fwrite(&l, 4, 1, f);
+	w = (channels > 2) ? 0xFFFE : formatTag; fwrite(&w, 2, 1, f); // 8bb: 0xFFFE = WAVE_FORMAT_EXTENSIBLE
+	w = (uint16_t)channels; fwrite(&w, 2, 1, f);
+	l = paula->audio.outputFreq; fwrite(&l, 4, 1, f);
+	l = paula->audio.outputFreq*bytesPerFrame; fwrite(&l, 4, 1, f);
+	w = (uint16_t)bytesPerFrame; fwrite(&w, 2, 1, f);
+	w = (uint16_t)(paulaGetBytesPerSample(paula) * 8); fwrite(&w, 2, 1, f);
+
+	if (channels > 2)
+	{
+		// 8bb: KSDATAFORMAT_SUBTYPE_PCM/IEEE_FLOAT = {formatTag}-0000-0010-8000-00AA00389B71
+		static const uint8_t subFormatTail[14] = { 0x00,0x00, 0x00,0x00, 0x10,0x00, 0x80,0x00, 0x00,0xAA,0x00,0x38,0x9B,0x71 };
+
+		w = 22; fwrite(&w, 2, 1, f); // cbSize
+		w = (uint16_t)(paulaGetBytesPerSample(paula) * 8); fwrite(&w, 2, 1, f); // wValidBitsPerSample
+		l = WAV_SPEAKER_QUAD; fwrite(&l, 4, 1, f); // dwChannelMask
+		w = formatTag; fwrite(&w, 2, 1, f);
+		fwrite(subFormatTail, 1, sizeof (subFormatTail), f);
+	}
+	else if (format == PAULA_FORMAT_F32)
+	{
+		w = 0; fwrite(&w, 2, 1, f); // cbSize
+	}
+
+	if (format == PAULA_FORMAT_F32)
+	{
+		// 12 bytes
+
+		const uint32_t fact = 0x74636166; // "fact"
+		fwrite(&fact, 4, 1, f);
+		l = 4; fwrite(&l, 4, 1, f);
+		fseek(f, 4, SEEK_CUR);
+	}
 
 	// 8 bytes
 
@@ -1382,218 +1769,232 @@ static void writeWAVHeader(FILE *f, int32_t audioFrequency)
 	fseek(f, 4, SEEK_CUR);
 }
 
-static void finishWAVHeader(FILE *f, uint32_t numDataBytes)
+static void finishWAVHeader(FILE *f, const paula_t *paula, int32_t channels, uint32_t numDataBytes)
 {
+	const int32_t format = paula->audio.format;
+	const uint32_t fmtSize = WAV_FMT_SIZE(format, channels);
+	const uint32_t factSize = WAV_FACT_SIZE(format);
+
 	fseek(f, 4, SEEK_SET);
-	uint32_t l = numDataBytes+4+24+8;
+	uint32_t l = numDataBytes+4+(8+fmtSize)+factSize+8;
 	fwrite(&l, 4, 1, f);
-	fseek(f, 12+24+4, SEEK_SET);
+
+	if (factSize > 0)
+	{
+		fseek(f, 12+8+fmtSize+8, SEEK_SET);
+		l = numDataBytes / (channels * paulaGetBytesPerSample(paula)); // 8bb: number of frames
+		fwrite(&l, 4, 1, f);
+	}
+
+	fseek(f, 12+8+fmtSize+factSize+4, SEEK_SET);
 	fwrite(&numDataBytes, 4, 1, f);
 }
 
-static int32_t ahxGetFrame(int16_t *streamOut) // 8bb: returns bytes mixed
+// 8bb: index 0 is the mix, 1..PAULA_VOICES are the stems (entries are NULL if not written)
+static void closeWAVFiles(FILE **f, uint8_t **buffer)
 {
-	if (audio.tickSampleCounter <= 0) // 8bb: new replayer tick
+	for (int32_t i = 0; i < 1+PAULA_VOICES; i++)
 	{
-		tickReplayer();
+		if (f[i] != NULL)
+			fclose(f[i]);
 
-		audio.tickSampleCounter = audio.samplesPerTickInt;
-
-		audio.tickSampleCounterFrac += audio.samplesPerTickFrac;
-		if (audio.tickSampleCounterFrac >= BPM_FRAC_SCALE)
-		{
-			audio.tickSampleCounterFrac &= BPM_FRAC_MASK;
-			audio.tickSampleCounter++;
-		}
+		if (buffer[i] != NULL)
+			free(buffer[i]);
 	}
-
-	const int32_t samplesToMix = audio.tickSampleCounter;
-
-	paulaMixSamples(streamOut, samplesToMix);
-	streamOut += samplesToMix * 2;
-
-	audio.tickSampleCounter -= samplesToMix;
-
-	return samplesToMix * 2 * sizeof (short);
 }
 
 // 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
-bool ahxRecordWAVFromRAM(const uint8_t *data, const char *fileOut, int32_t subSong,
-	int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation)
+bool ahxRecordStemsWAVFromModule(ahxPlayer_t *player, ahxModule_t *module, const char *fileOut, const char *const *stemFilesOut,
+	int32_t subSong, int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation)
 {
-	ahxErrCode = ERR_SUCCESS;
+	const char *fileName[1+PAULA_VOICES];
+	FILE *f[1+PAULA_VOICES];
+	uint8_t *buffer[1+PAULA_VOICES];
+	int32_t channels[1+PAULA_VOICES];
+	uint32_t totalBytes[1+PAULA_VOICES];
 
-	if (!ahxInitWaves())
+	if (!ahxInitRender(player, audioFreq, masterVol, stereoSeparation)) // 8bb: modifies error code
+		return false;
+
+	if (!ahxSetModule(player, module)) // 8bb: modifies error code
 	{
-		ahxErrCode = ERR_OUT_OF_MEMORY;
+		ahxCloseRender(player);
 		return false;
 	}
 
-	if (!paulaInit(audioFreq))
+	fileName[0] = fileOut;
+	channels[0] = player->paula.audio.channels;
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
 	{
-		ahxFreeWaves();
-		ahxErrCode = ERR_OUT_OF_MEMORY;
-		return false;
+		fileName[1+i] = (stemFilesOut != NULL) ? stemFilesOut[i] : NULL;
+		channels[1+i] = 1;
 	}
 
-	paulaSetStereoSeparation(stereoSeparation);
-	paulaSetMasterVolume(masterVol);
+	const int32_t maxSamplesPerTick = (int32_t)ceil(audioFreq / amigaCIAPeriod2Hz(AHX_HIGHEST_CIA_PERIOD)); // 8bb: covers several ticks at faster tempos
 
-	if (!ahxLoadFromRAM(data)) // 8bb: modifies error code
+	memset(f, 0, sizeof (f));
+	memset(buffer, 0, sizeof (buffer));
+	memset(totalBytes, 0, sizeof (totalBytes));
+
+	bool hasStems = false;
+	for (int32_t i = 0; i < 1+PAULA_VOICES; i++)
 	{
-		paulaClose();
-		ahxFreeWaves();
-		return false;
-	}
+		if (fileName[i] == NULL)
+			continue;
 
-	const int32_t maxSamplesPerTick = (int32_t)ceil(audioFreq / amigaCIAPeriod2Hz(AHX_HIGHEST_CIA_PERIOD));
+		buffer[i] = (uint8_t *)malloc(maxSamplesPerTick * channels[i] * paulaGetBytesPerSample(&player->paula));
+		if (buffer[i] == NULL)
+		{
+			closeWAVFiles(f, buffer);
+			ahxFree(player);
+			ahxCloseRender(player);
+			player->errCode = ERR_OUT_OF_MEMORY;
+			return false;
+		}
+
+		if (i > 0)
+			hasStems = true;
+	}
 
-	int16_t *outputBuffer = (int16_t *)malloc(maxSamplesPerTick * (2 * sizeof (int16_t)));
-	if (outputBuffer == NULL)
+	for (int32_t i = 0; i < 1+PAULA_VOICES; i++)
 	{
-		ahxFree();
-		paulaClose();
-		ahxFreeWaves();
-		ahxErrCode = ERR_OUT_OF_MEMORY;
-		return false;
+		if (fileName[i] == NULL)
+			continue;
+
+		f[i] = fopen(fileName[i], "wb");
+		if (f[i] == NULL)
+		{
+			closeWAVFiles(f, buffer);
+			ahxFree(player);
+			ahxCloseRender(player);
+			player->errCode = ERR_FILE_IO;
+			return false;
+		}
+
+		writeWAVHeader(f[i], &player->paula, channels[i]);
 	}
 
-	FILE *f = fopen(fileOut, "wb");
-	if (f == NULL)
+	player->isRecordingToWAV = true;
+	if (!ahxPlay(player, subSong)) // 8bb: modifies error code (the play command is applied by the first ahxRender() call)
 	{
-		ahxFree();
-		paulaClose();
-		ahxFreeWaves();
-		free(outputBuffer);
-		ahxErrCode = ERR_FILE_IO;
+		player->isRecordingToWAV = false;
+		closeWAVFiles(f, buffer);
+		ahxFree(player);
+		ahxCloseRender(player);
 		return false;
 	}
 
-	writeWAVHeader(f, audioFreq);
+	player->song.loopTimes = songLoopTimes;
 
-	isRecordingToWAV = true;
-	if (!ahxPlay(subSong)) // 8bb: modifies error code (also resets audio.tickSampleCounter/audio.tickSampleCounterFrac)
+	void *stemBuffer[PAULA_VOICES];
+	for (int32_t i = 0; i < PAULA_VOICES; i++)
+		stemBuffer[i] = buffer[1+i];
+
+	while (player->isRecordingToWAV) // 8bb: can also be cleared from another thread to abort
 	{
-		isRecordingToWAV = false;
-		fclose(f);
-		ahxFree();
-		paulaClose();
-		ahxFreeWaves();
-		free(outputBuffer);
-		return false;
-	}
+		bool songEnded;
 
-	song.loopTimes = songLoopTimes;
+		// 8bb: one pass for the mix and all stems
+		const int32_t framesMixed = ahxRenderStems(player, buffer[0], hasStems ? stemBuffer : NULL, maxSamplesPerTick, &songEnded);
 
-	uint32_t totalBytes = 0;
-	while (isRecordingToWAV)
+		for (int32_t i = 0; i < 1+PAULA_VOICES; i++)
+		{
+			if (f[i] == NULL)
+				continue;
+
+			const int32_t bytesMixed = framesMixed * channels[i] * paulaGetBytesPerSample(&player->paula);
+			fwrite(buffer[i], 1, bytesMixed, f[i]);
+			totalBytes[i] += bytesMixed;
+		}
+
+		if (songEnded)
+			break;
+	}
+
+	for (int32_t i = 0; i < 1+PAULA_VOICES; i++)
 	{
-		const int32_t bytesMixed = ahxGetFrame(outputBuffer);
-		fwrite(outputBuffer, 1, bytesMixed, f);
-		totalBytes += bytesMixed;
+		if (f[i] != NULL)
+			finishWAVHeader(f[i], &player->paula, channels[i], totalBytes[i]);
 	}
 
-	finishWAVHeader(f, totalBytes);
-	isRecordingToWAV = false;
+	player->isRecordingToWAV = false;
 
-	fclose(f);
-	ahxFree();
-	paulaClose();
-	ahxFreeWaves();
-	free(outputBuffer);
+	closeWAVFiles(f, buffer);
+	ahxFree(player);
+	ahxCloseRender(player);
 
 	return true;
 }
 
 // 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
-bool ahxRecordWAV(const char *fileIn, const char *fileOut, int32_t subSong,
+bool ahxRecordWAVFromModule(ahxPlayer_t *player, ahxModule_t *module, const char *fileOut, int32_t subSong,
 	int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation)
 {
-	ahxErrCode = ERR_SUCCESS;
+	return ahxRecordStemsWAVFromModule(player, module, fileOut, NULL, subSong,
+		songLoopTimes, audioFreq, masterVol, stereoSeparation);
+}
 
-	if (!ahxInitWaves())
-	{
-		ahxErrCode = ERR_OUT_OF_MEMORY;
-		return false;
-	}
+// 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
+bool ahxRecordWAVFromRAM(ahxPlayer_t *player, const uint8_t *data, const char *fileOut, int32_t subSong,
+	int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation)
+{
+	int32_t errCode;
 
-	if (!paulaInit(audioFreq))
+	ahxModule_t *module = ahxLoadModuleFromRAM(data, &errCode);
+	if (module == NULL)
 	{
-		ahxFreeWaves();
-		ahxErrCode = ERR_OUT_OF_MEMORY;
+		player->errCode = (uint8_t)errCode;
 		return false;
 	}
 
-	paulaSetStereoSeparation(stereoSeparation);
-	paulaSetMasterVolume(masterVol);
+	const bool result = ahxRecordWAVFromModule(player, module, fileOut, subSong,
+		songLoopTimes, audioFreq, masterVol, stereoSeparation);
 
-	if (!ahxLoad(fileIn)) // 8bb: modifies error code
-	{
-		paulaClose();
-		ahxFreeWaves();
-		return false;
-	}
-
-	const int32_t maxSamplesPerTick = (int32_t)ceil(audioFreq / amigaCIAPeriod2Hz(AHX_HIGHEST_CIA_PERIOD));
+	ahxReleaseModule(module);
+	return result;
+}
 
-	int16_t *outputBuffer = (int16_t *)malloc(maxSamplesPerTick * (2 * sizeof (int16_t)));
-	if (outputBuffer == NULL)
-	{
-		ahxFree();
-		paulaClose();
-		ahxFreeWaves();
-		ahxErrCode = ERR_OUT_OF_MEMORY;
-		return false;
-	}
+// 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
+bool ahxRecordWAV(ahxPlayer_t *player, const char *fileIn, const char *fileOut, int32_t subSong,
+	int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation)
+{
+	int32_t errCode;
 
-	FILE *f = fopen(fileOut, "wb");
-	if (f == NULL)
+	ahxModule_t *module = ahxLoadModule(fileIn, &errCode);
+	if (module == NULL)
 	{
-		ahxFree();
-		paulaClose();
-		ahxFreeWaves();
-		free(outputBuffer);
-		ahxErrCode = ERR_FILE_IO;
+		player->errCode = (uint8_t)errCode;
 		return false;
 	}
 
-	writeWAVHeader(f, audioFreq);
+	const bool result = ahxRecordWAVFromModule(player, module, fileOut, subSong,
+		songLoopTimes, audioFreq, masterVol, stereoSeparation);
 
-	isRecordingToWAV = true;
-	if (!ahxPlay(subSong)) // 8bb: modifies error code (also resets audio.tickSampleCounter/audio.tickSampleCounterFrac)
-	{
-		isRecordingToWAV = false;
-		fclose(f);
-		ahxFree();
-		paulaClose();
-		ahxFreeWaves();
-		free(outputBuffer);
-		return false;
-	}
+	ahxReleaseModule(module);
+	return result;
+}
 
-	song.loopTimes = songLoopTimes;
+// 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
+bool ahxRecordStemsWAV(ahxPlayer_t *player, const char *fileIn, const char *fileOut, const char *const *stemFilesOut,
+	int32_t subSong, int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation)
+{
+	int32_t errCode;
 
-	uint32_t totalBytes = 0;
-	while (isRecordingToWAV)
+	ahxModule_t *module = ahxLoadModule(fileIn, &errCode);
+	if (module == NULL)
 	{
-		const uint32_t size = ahxGetFrame(outputBuffer);
-		fwrite(outputBuffer, 1, size, f);
-		totalBytes += size;
+		player->errCode = (uint8_t)errCode;
+		return false;
 	}
 
-	finishWAVHeader(f, totalBytes);
-	isRecordingToWAV = false;
-
-	fclose(f);
-	ahxFree();
-	paulaClose();
-	ahxFreeWaves();
-	free(outputBuffer);
+	const bool result = ahxRecordStemsWAVFromModule(player, module, fileOut, stemFilesOut, subSong,
+		songLoopTimes, audioFreq, masterVol, stereoSeparation);
 
-	return true;
+	ahxReleaseModule(module);
+	return result;
 }
 
-int32_t ahxGetErrorCode(void)
+int32_t ahxGetErrorCode(ahxPlayer_t *player)
 {
-	return ahxErrCode;
+	return player->errCode;
 }
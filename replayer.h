@@ -12,7 +12,9 @@ enum
 	ERR_FILE_IO         = 3,
 	ERR_NOT_AN_AHX      = 4,
 	ERR_NO_WAVES        = 5,
-	ERR_SONG_NOT_LOADED = 6
+	ERR_SONG_NOT_LOADED = 6,
+	ERR_CMD_QUEUE_FULL  = 7,
+	ERR_DEVICE_IN_USE   = 8 // 8bb: setting can't be changed while the player owns the audio device (ahxInit())
 };
 
 #define AHX_HIGHEST_CIA_PERIOD 14209 /* ~49.92Hz */
@@ -21,6 +23,10 @@ enum
 #define WHITENOISE_LENGTH (0x280*3)
 #define WAV_FILTER_LENGTH (252 + 252 + (0x80 * 32) + WHITENOISE_LENGTH)
 
+// 8bb: filterPos (1..63, 32 = no filter) -> filter level bit (low-pass levels 0..30 for 1..31, high-pass for 33..63)
+#define FILTER_LEVEL_BIT(pos) (((pos) == 32) ? 0 : (1UL << (((pos) < 32) ? ((pos)-1) : ((pos)-33))))
+#define FILTER_LEVELS_ALL 0x7FFFFFFFUL
+
 #define CLAMP(x, low, high) (((x) > (high)) ? (high) : (((x) < (low)) ? (low) : (x)))
 
 // bit-rotate macros
@@ -86,7 +92,7 @@ typedef struct // 8bb: channel structure
 	int16_t dDelta; // 8 bit/8 bit floating! (8bb: 8.8fp)
 	int16_t rDelta; // 8 bit/8 bit floating! (8bb: 8.8fp)
 
-	instrument_t *Instrument; // ^Current_Instrument
+	const instrument_t *Instrument; // ^Current_Instrument
 	uint8_t Waveform; // 1..4 (or 0..3 senseless?)
 	uint8_t Wavelength; // 0..5: 4/8/10/20/40/80 ($)
 	int16_t InstrPeriod; // !P!
@@ -97,6 +103,7 @@ typedef struct // 8bb: channel structure
 	uint8_t TrackMasterVolume; // real maximum volume!
 
 	bool NewWaveform; // flag!
+	bool WaveformPending; // 8bb: not copied to the Paula buffer yet (voice disabled, see ahxSetVoiceMask())
 	bool PlantSquare; // flag! now baused by 9xx!
 	bool SquareReverse; // flag!
 	bool IgnoreSquare;
@@ -148,7 +155,7 @@ typedef struct // 8bb: channel structure
 	uint8_t perfCurrent; // countin' down!!!!
 	uint8_t perfSpeed; // 'cause speed can b chgd!
 	uint8_t perfWait; // Speed->Wait
-	uint8_t *perfList;
+	const uint8_t *perfList;
 
 	uint8_t NoteDelayWait;
 	bool NoteDelayOn;
@@ -163,27 +170,43 @@ typedef struct // 8bb: channel structure
 	int8_t *SquareTempBuffer;
 } plyVoiceTemp_t;
 
-typedef struct // 8bb: song strucure
+typedef struct ahxModule_t // 8bb: parsed module, read-only after loading (shared between players)
 {
-	// 8bb: added these
-	volatile bool songLoaded;
-	uint8_t Subsong;
+	volatile int32_t refCount; // 8bb: see ahxRetainModule()/ahxReleaseModule()
+
 	uint16_t SongCIAPeriod;
-	int32_t loopCounter, loopTimes; // 8bb: for WAV rendering
-	double dBPM;
-	instrument_t EmptyInstrument; // 8bb: initialized in ahxPlay()
-	// ----------------------------
+	instrument_t EmptyInstrument; // 8bb: initialized in the loader
 
-	volatile bool intPlaying;
 	char Name[255+1];
 	uint8_t Revision;
 
 	uint8_t highestTrack, numInstruments;
 	uint8_t Subsongs;
 
+	uint16_t TrackLength;
+	uint16_t ResNr;
+	uint16_t LenNr;
+
+	uint16_t *SubSongTable;
+	uint8_t *PosTable;
+	uint8_t *TrackTable;
+	instrument_t *Instruments[63];
+
+	uint32_t filterLevels; // 8bb: filter levels the song can reach (estimated by the loader), see FILTER_LEVEL_BIT()
+} ahxModule_t;
+
+typedef struct // 8bb: song strucure (playback state only, the song data is in ahxModule_t)
+{
+	// 8bb: added these
+	uint8_t Subsong;
+	int32_t loopCounter, loopTimes; // 8bb: for WAV rendering
+	double dBPM;
+	// ----------------------------
+
+	volatile bool intPlaying;
+
 	plyVoiceTemp_t pvt[PAULA_VOICES];
 
-	uint16_t TrackLength;
 	uint16_t StepWaitFrames; // 0: wait step!
 	bool GetNewPosition; // flag!
 	uint8_t Tempo; // some default?
@@ -195,15 +218,8 @@ typedef struct // 8bb: song strucure
 
 	uint16_t NoteNr;
 	uint16_t PosNr;
-	uint16_t ResNr;
-	uint16_t LenNr;
-
-	uint16_t *SubSongTable;
-	uint8_t *PosTable;
-	uint8_t *TrackTable;
-	instrument_t *Instruments[63];
 
-	int8_t *WaveformTab[4]; // has to be inited!!!
+	const int8_t *WaveformTab[4]; // has to be inited!!!
 } song_t;
 
 #ifdef _MSC_VER
@@ -218,10 +234,6 @@ typedef struct
 	int8_t squares[0x80 * 32];
 	int8_t whiteNoiseBig[WHITENOISE_LENGTH];
 	int8_t highPasses[WAV_FILTER_LENGTH * 31];
-
-	// 8bb: moved these here, so that they get dword-aligned
-	int8_t SquareTempBuffer[PAULA_VOICES][0x80];
-	int8_t currentVoice[PAULA_VOICES][0x280];
 }
 #ifdef __GNUC__
 __attribute__ ((packed))
@@ -231,37 +243,182 @@ waveforms_t;
 #pragma pack(pop)
 #endif
 
-extern volatile bool isRecordingToWAV;
-extern song_t song;
-extern waveforms_t *waves; // 8bb: dword-aligned from malloc()
+#define AHX_CMD_QUEUE_SIZE 64 /* must be a power of two */
+
+enum // 8bb: control commands, queued by ahxPlay()/ahxStop()/ahxNextPattern()/ahxPrevPattern()
+{
+	CMD_PLAY = 0,
+	CMD_STOP = 1,
+	CMD_NEXT_PATTERN = 2,
+	CMD_PREV_PATTERN = 3,
+	CMD_FREE = 4, // 8bb: ahxFree() on the player that owns the audio device
+	CMD_SET_VOICE_MASK = 5 // 8bb: ahxSetVoiceMask() on the player that owns the audio device
+};
+
+typedef struct ahxCommand_t
+{
+	uint8_t type;
+	int32_t param;
+} ahxCommand_t;
+
+typedef struct ahxCmdQueue_t // 8bb: lock-free ring, one producer (control thread) and one consumer (mixer)
+{
+	volatile uint32_t writePos, readPos;
+	ahxCommand_t cmd[AHX_CMD_QUEUE_SIZE];
+} ahxCmdQueue_t;
+
+struct ahxPlayer_t // 8bb: one complete player instance (song, Paula and waveforms), see ahxCreatePlayer()
+{
+	ahxModule_t *module; // 8bb: NULL if no song is loaded
+	song_t song;
+	paula_t paula;
+	uint32_t filterLevelsDone; // 8bb: filter levels that have been generated in "waves"
+	const waveforms_t *waves; // 8bb: read-only, dword-aligned (see waves.c)
+
+	// 8bb: per-voice buffers (moved out of waveforms_t), keep them right after a pointer so that they get dword-aligned
+	int8_t SquareTempBuffer[PAULA_VOICES][0x80];
+	int8_t currentVoice[PAULA_VOICES][0x280];
+
+	ahxCmdQueue_t cmdQueue;
+	int32_t outputChannels, outputFormat; // 8bb: see ahxSetOutputChannels()/ahxSetOutputFormat()
+	int32_t disabledVoices; // 8bb: see ahxSetVoiceMask(), control thread copy (the mixer uses paula.audio.disabledVoices)
+	bool ownsAudioDevice; // 8bb: set by ahxInit(), ahxFree() then has to go through the mixer
+	volatile bool isRecordingToWAV, songEnded;
+	uint8_t errCode;
+};
+
+/* 8bb:
+** All state is kept inside the player, so different players can be used
+** from different threads at the same time. A single player is not thread-safe,
+** except that ahxPlay()/ahxStop()/ahxNextPattern()/ahxPrevPattern()/ahxSetVoiceMask()
+** only queue a command that the mixer picks up before mixing its next block (they
+** never lock the mixer). Only one player at a time can own the audio device (ahxInit()).
+** ahxFree() (also used by ahxLoad()/ahxSetModule()) doesn't lock the mixer either, on the
+** player that owns the audio device it queues a command and waits until the mixer has taken it.
+*/
+ahxPlayer_t *ahxCreatePlayer(void); // 8bb: returns NULL if out of memory
+void ahxDestroyPlayer(ahxPlayer_t *player);
+
+// waves.c
+void ahxGenerateWaves(waveforms_t *waves); // 8bb: used by ahxInitWaves() and tools/wavegen.c
+bool ahxTestWaveGenerator(void); // 8bb: self-test, checks the SIMD filter generator against the plain C one
+bool ahxInitWaves(ahxPlayer_t *player);
+void ahxFreeWaves(ahxPlayer_t *player);
+void ahxGenerateFilterLevels(ahxPlayer_t *player, uint32_t levels); // 8bb: generates missing filter levels
 
 // loader.c
-bool ahxLoadFromRAM(const uint8_t *data);
-bool ahxLoad(const char *filename);
-void ahxFree(void);
+
+/* 8bb:
+** A module can be loaded once and then be played by any number of players at the same time.
+** The loaded module starts out with a reference count of 1 (owned by the caller), and every
+** player it's attached to (ahxSetModule()) holds its own reference until ahxFree() is called.
+** errCode can be NULL.
+*/
+ahxModule_t *ahxLoadModuleFromRAM(const uint8_t *data, int32_t *errCode);
+ahxModule_t *ahxLoadModule(const char *filename, int32_t *errCode);
+ahxModule_t *ahxRetainModule(ahxModule_t *module);
+void ahxReleaseModule(ahxModule_t *module);
+bool ahxSetModule(ahxPlayer_t *player, ahxModule_t *module);
+
+bool ahxLoadFromRAM(ahxPlayer_t *player, const uint8_t *data);
+bool ahxLoad(ahxPlayer_t *player, const char *filename);
+void ahxFree(ahxPlayer_t *player);
 // --------------------------
 
-void ahxNextPattern(void);
-void ahxPrevPattern(void);
+void ahxNextPattern(ahxPlayer_t *player);
+void ahxPrevPattern(ahxPlayer_t *player);
 
 // 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
-bool ahxInit(int32_t audioFreq, int32_t audioBufferSize, int32_t masterVol, int32_t stereoSeparation);
-
-void ahxClose(void);
-
-bool ahxPlay(int32_t subSong);
-void ahxStop(void);
+bool ahxInit(ahxPlayer_t *player, int32_t audioFreq, int32_t audioBufferSize, int32_t masterVol, int32_t stereoSeparation);
+
+void ahxClose(ahxPlayer_t *player);
+
+/* 8bb: Pull-based rendering, no audio device needed (don't use ahxInit() for this player).
+** Call ahxInitRender(), load a song and ahxPlay(), then pull as many frames as you want
+** with ahxRender() (out must fit frames*paulaGetBytesPerFrame() bytes). It returns how many frames were rendered,
+** which is less than requested once the song has ended (songEnded is then set, can be NULL).
+** The output doesn't depend on how many frames are pulled per call (or per audio callback on the audio device).
+** Set player->song.loopTimes to render more song loops before it ends.
+** masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
+*/
+bool ahxInitRender(ahxPlayer_t *player, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation);
+
+/* 8bb: 1 = mono (all voices mixed into one channel, at the level of 0% stereo separation), 2 = stereo (default),
+** 4 = one voice per channel (not mixed, at the level of 100% stereo separation, same as the stems of ahxRenderStems()).
+** 4-channel WAVs are written as WAVE_FORMAT_EXTENSIBLE, with a quad speaker layout (FL FR BL BR).
+** Call it before ahxInit()/ahxInitRender() only, the setting is kept by the player for those and ahxRecordWAV().
+** The audio device is opened with this channel count, so on the player that owns it, a change is refused
+** (returns false, error code ERR_DEVICE_IN_USE). ahxClose() first to switch.
+*/
+bool ahxSetOutputChannels(ahxPlayer_t *player, int32_t channels);
+
+/* 8bb: PAULA_FORMAT_S16 (default), PAULA_FORMAT_S24 or PAULA_FORMAT_F32, for ahxRender() and the WAV recorder
+** (24-bit/float WAVs, float is written as WAVE_FORMAT_IEEE_FLOAT). Only 16-bit is dithered.
+** Kept like the channel count above, before ahxInit()/ahxInitRender() only.
+** The audio device (ahxInit()) is always 16-bit, so on the player that owns it, anything else is refused
+** (returns false, error code ERR_DEVICE_IN_USE).
+*/
+bool ahxSetOutputFormat(ahxPlayer_t *player, int32_t format);
+
+/* 8bb: Bit 0..3 = voice 1..4 enabled (default = 15). The replayer keeps running all voices, but a disabled voice
+** costs no mixing or waveform copying, and is silent (also in the stems). It's frozen while disabled, and
+** continues from there when it's enabled again. Kept like the channel count above, and can be changed at any time.
+** On the player that owns the audio device, it's queued like ahxStop() and applied before the next mixed block
+** (returns false, error code ERR_CMD_QUEUE_FULL, if the queue is full).
+*/
+bool ahxSetVoiceMask(ahxPlayer_t *player, int32_t mask);
+int32_t ahxRender(ahxPlayer_t *player, void *out, int32_t frames, bool *songEnded);
+
+/* 8bb: Same as ahxRender(), but also renders every voice to its own mono buffer (stems) in the same pass.
+** stems[0..3] must fit frames*paulaGetBytesPerSample() bytes each (NULL skips a voice), out can be NULL.
+** The mix is the same as from ahxRender(), see paulaMixSamplesStems() for the stem levels.
+*/
+int32_t ahxRenderStems(ahxPlayer_t *player, void *out, void *const *stems, int32_t frames, bool *songEnded);
+
+/* 8bb: Same as ahxRender(), but also renders up to PAULA_MAX_MIX_VARIANTS mix variants (other master volume and/or
+** stereo separation, set up with paulaInitMixVariant(&player->paula, ...) after ahxInitRender()) in the same pass.
+** variantOut[0..numVariants-1] must fit frames*paulaGetBytesPerFrame() bytes each (NULL skips one), out can be NULL.
+** Every variant is the same as the output of a separate render with its settings.
+*/
+int32_t ahxRenderVariants(ahxPlayer_t *player, void *out, paulaMixVariant_t *variants, void *const *variantOut,
+	int32_t numVariants, int32_t frames, bool *songEnded);
+void ahxCloseRender(ahxPlayer_t *player);
+
+bool ahxPlay(ahxPlayer_t *player, int32_t subSong);
+void ahxStop(ahxPlayer_t *player);
 
 // 8bb: added these WAV recorders
 
 // 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
-bool ahxRecordWAVFromRAM(const uint8_t *data, const char *fileOut, int32_t subSong,
+bool ahxRecordWAVFromModule(ahxPlayer_t *player, ahxModule_t *module, const char *fileOut, int32_t subSong,
+	int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation);
+
+// 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
+bool ahxRecordWAVFromRAM(ahxPlayer_t *player, const uint8_t *data, const char *fileOut, int32_t subSong,
 	int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation);
 
 // 8bb: masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
-bool ahxRecordWAV(const char *fileIn, const char *fileOut, int32_t subSong,
+bool ahxRecordWAV(ahxPlayer_t *player, const char *fileIn, const char *fileOut, int32_t subSong,
 	int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation);
 
-int32_t ahxGetErrorCode(void);
+/* 8bb: Records the mix (fileOut) and/or every voice as a mono WAV (stemFilesOut[0..3]) in one pass over the song.
+** Any of the filenames (or stemFilesOut itself) can be NULL.
+** masterVol = 0..256 (default = 256), stereoSeparation = 0..100 (percentage, default = 20)
+*/
+bool ahxRecordStemsWAVFromModule(ahxPlayer_t *player, ahxModule_t *module, const char *fileOut, const char *const *stemFilesOut,
+	int32_t subSong, int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation);
+
+bool ahxRecordStemsWAV(ahxPlayer_t *player, const char *fileIn, const char *fileOut, const char *const *stemFilesOut,
+	int32_t subSong, int32_t songLoopTimes, int32_t audioFreq, int32_t masterVol, int32_t stereoSeparation);
+
+int32_t ahxGetErrorCode(ahxPlayer_t *player);
+
+void tickReplayer(ahxPlayer_t *player);
 
-void tickReplayer(void);
+/* 8bb: Runs the replayer ahead over the next block of up to maxFrames frames (capped to the mix buffer length),
+** with its Paula writes queued at their frame offsets (paulaQueueEvents()). Returns the block length, which is
+** then mixed with one paulaMixSamples*() call. 0 if stopAtSongEnd is set and the song has ended.
+*/
+int32_t runReplayerBlock(ahxPlayer_t *player, int32_t maxFrames, bool stopAtSongEnd);
+void processCommandQueue(ahxPlayer_t *player); // 8bb: mixer only, call before mixing a block
+void detachModule(ahxPlayer_t *player); // 8bb: stops playback and takes the song away from the mixer (for ahxFree()), never locks the mixer
@@ -0,0 +1,371 @@
+/*
+** 8bb:
+** Render regression test. Renders a small test song (synthetic, made for this test) in every output
+** mode and with every mixer kernel the CPU has, pulling it with ahxRender() in different chunk sizes.
+** Every chunk size has to give the same output as the reference render (FNV-1a hash of the output).
+** The 16-bit modes are also pulled through the audio device callback (paulaOutputSamples()) with the
+** same sizes, which has to give the same output as ahxRender(). Switching between the float and the
+** fixed-point mixer mid-song is checked too.
+**
+** The fixed-point mixer is bit-exact everywhere. The float references are from an x86-64 build
+** (SSE2 math), so on other CPUs the float modes are only checked against each other.
+**
+** Usage: rendertest
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../replayer.h"
+#include "../paula.h"
+
+#if defined __x86_64__ || defined _M_X64
+#define CHECK_FLOAT_HASHES true
+#else
+#define CHECK_FLOAT_HASHES false
+#endif
+
+#define TEST_FREQ 44100
+#define MAX_CHUNK 5000
+
+typedef struct testMode_t
+{
+	const char *name;
+	int32_t channels, format, quality;
+	bool fixedPoint;
+	uint32_t hash; // 8bb: reference
+} testMode_t;
+
+static const testMode_t testModes[] =
+{
+	{ "stereo 16-bit",        2, PAULA_FORMAT_S16, PAULA_QUALITY_BLEP,       false, 0x6DCA8CDC },
+	{ "mono 16-bit",          1, PAULA_FORMAT_S16, PAULA_QUALITY_BLEP,       false, 0x8218F4EB },
+	{ "4-channel 16-bit",     4, PAULA_FORMAT_S16, PAULA_QUALITY_BLEP,       false, 0x4DD0B8E7 },
+	{ "stereo 24-bit",        2, PAULA_FORMAT_S24, PAULA_QUALITY_BLEP,       false, 0x63DA9DE6 },
+	{ "stereo float",         2, PAULA_FORMAT_F32, PAULA_QUALITY_BLEP,       false, 0x388CF822 },
+	{ "stereo short BLEP",    2, PAULA_FORMAT_S16, PAULA_QUALITY_SHORT_BLEP, false, 0x6151A8FF },
+	{ "stereo no BLEP",       2, PAULA_FORMAT_S16, PAULA_QUALITY_NO_BLEP,    false, 0x8DA094B4 },
+	{ "stereo fixed-point",   2, PAULA_FORMAT_S16, PAULA_QUALITY_BLEP,       true,  0x16A7FEEE },
+	{ "4-channel fixed-point", 4, PAULA_FORMAT_S16, PAULA_QUALITY_BLEP,       true,  0xB2577DEF }
+};
+
+static const int32_t chunkSizes[] = { 300, 2048, MAX_CHUNK };
+
+static const uint8_t testSong[] =
+{
+	0x54,0x48,0x58,0x01,0x00,0x00,0x60,0x06,0x00,0x01,0x20,0x07,0x06,0x02,0x00,0x02,
+	0x00,0x04,0x06,0xF7,0x03,0x0B,0x06,0xF7,0x06,0x07,0x07,0x07,0x07,0xF6,0x06,0x02,
+	0x05,0x05,0x05,0xF9,0x02,0xFB,0x02,0x01,0x07,0x03,0x02,0x01,0x04,0xFE,0x06,0xFD,
+	0x04,0x09,0x05,0x09,0x00,0x00,0x00,0xFA,0x07,0xF7,0x01,0xF4,0x05,0xFE,0x05,0x0B,
+	0x06,0xF9,0x00,0x00,0x00,0x18,0x30,0x00,0x00,0x00,0x00,0x9C,0x20,0x00,0x00,0x0A,
+	0xC9,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xF0,0x30,0x00,
+	0xE4,0x53,0x78,0x30,0x3E,0xB2,0x00,0x00,0x00,0xE8,0x40,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0xDC,0x4A,0xEC,0x00,0x05,0xFF,0x00,0x00,0x00,0xE4,0x40,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x09,0x34,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xB0,0x50,0x00,0x00,
+	0x00,0x00,0xD4,0x20,0x00,0x94,0x6E,0x25,0x00,0x0E,0x22,0x38,0x10,0x00,0x00,0x09,
+	0x1F,0xB0,0x12,0x0C,0xEC,0x10,0x00,0xF0,0x20,0x00,0x00,0x0E,0x11,0x0C,0x10,0x00,
+	0x00,0x00,0x00,0x58,0x4C,0xD3,0x00,0x00,0x00,0xAC,0x60,0x00,0x74,0x20,0x00,0x00,
+	0x00,0x00,0xE0,0x3E,0xA5,0x90,0x20,0x00,0x24,0x2C,0x1D,0x00,0x02,0x74,0x00,0x00,
+	0x00,0x00,0x0A,0x8E,0x00,0x01,0xC4,0x20,0x50,0x00,0x1C,0x14,0x0D,0x00,0x00,0x00,
+	0xA8,0x44,0x37,0x00,0x0A,0x5C,0x00,0x00,0x00,0x00,0x02,0xBB,0xF0,0x30,0x00,0x00,
+	0x00,0x00,0x34,0x60,0x00,0x00,0x04,0x3E,0x00,0x00,0x00,0x08,0x30,0x00,0x00,0x0C,
+	0x5E,0x00,0x09,0x21,0x00,0x02,0x29,0x00,0x00,0x00,0x38,0x6E,0xC3,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x88,0x40,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x2C,
+	0x40,0x00,0x00,0x00,0x00,0x00,0x0C,0x0C,0x00,0x0A,0x22,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x4C,0x44,0x2A,0x00,0x0E,0xD3,0x88,0x20,0x00,0xE8,0x20,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x0C,0x81,0x00,0x00,0x00,0xB8,0x60,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xA0,0x20,0x00,0x00,0x00,0x00,0x00,0x0C,
+	0x3B,0x38,0x60,0x00,0x38,0x10,0x00,0x00,0x00,0x00,0xEC,0x50,0x00,0x00,0x00,0x00,
+	0xB0,0x40,0x00,0x00,0x0C,0x1A,0x00,0x00,0x00,0x00,0x0E,0xA5,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0xC4,0x44,0x11,0x00,0x00,0x00,0x00,0x05,0xEF,0x00,0x00,
+	0x00,0x00,0x00,0x00,0xE0,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xD4,0x30,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x04,0x1A,0x00,0x00,0x00,0x3C,0x40,0x00,0x00,
+	0x02,0x39,0x00,0x00,0x00,0x00,0x09,0x0C,0x60,0x20,0x00,0x00,0x00,0x00,0xB8,0x40,
+	0x00,0x48,0x34,0x4D,0x24,0x2E,0xC3,0xD4,0x60,0x00,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x0E,0xC5,0x50,0x40,0x00,0xE8,
+	0x30,0x00,0xF0,0x20,0x00,0x08,0x10,0x00,0xEC,0x60,0x00,0x8C,0x3E,0xA4,0xA4,0x20,
+	0x00,0x80,0x10,0x00,0x00,0x00,0x00,0x60,0x34,0x1F,0x00,0x09,0x31,0x00,0x03,0x5A,
+	0x00,0x00,0x00,0x00,0x0E,0xB0,0xC8,0x60,0x00,0x10,0x40,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x84,0x50,0x00,0x00,0x00,0x00,0x00,0x0A,0xE7,0x1C,0x40,0x00,0xF0,0x60,
+	0x00,0x68,0x30,0x00,0x00,0x04,0x2C,0x70,0x60,0x00,0xD4,0x60,0x00,0x00,0x00,0x00,
+	0x24,0x5C,0x40,0x00,0x0E,0x45,0x00,0x09,0x27,0x8C,0x1C,0xBB,0xA0,0x60,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x1C,0x20,0x00,0x64,0x2A,0x49,0x68,0x30,0x00,0x00,0x00,
+	0x00,0x00,0x0C,0xD5,0x90,0x6E,0xB1,0x68,0x53,0x0C,0x00,0x00,0x00,0x00,0x04,0x67,
+	0x34,0x1C,0xDB,0x38,0x20,0x00,0x00,0x0E,0xB0,0x6C,0x60,0x00,0x00,0x00,0x00,0xB4,
+	0x61,0x6D,0x44,0x50,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x2C,0x40,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x14,0x20,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x05,0x6A,0x00,0x00,0x00,0xCC,0x19,0x0B,0x44,0x60,0x00,0x00,
+	0x0C,0x02,0x9C,0x40,0x00,0x00,0x00,0x00,0x18,0x40,0x00,0x00,0x0E,0x41,0xB8,0x30,
+	0x00,0x00,0x00,0x00,0x38,0x54,0x49,0x00,0x0C,0x82,0x40,0x2E,0xD0,0x00,0x00,0x00,
+	0x64,0x60,0x00,0x48,0x10,0x00,0xCC,0x40,0x00,0x00,0x00,0x00,0x08,0x10,0x00,0x28,
+	0x20,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x90,0x54,0x11,0x84,0x61,0xB5,0x00,0x00,
+	0x00,0x60,0x10,0x00,0xCC,0x6C,0x24,0xD8,0x64,0x06,0x00,0x00,0x00,0x00,0x00,0x00,
+	0x30,0x20,0x00,0xC4,0x60,0x00,0x00,0x01,0x7E,0x00,0x00,0x00,0x14,0x3E,0x11,0x34,
+	0x1A,0x28,0x00,0x04,0x44,0xCC,0x23,0xEB,0x00,0x0E,0x24,0x00,0x00,0x00,0x00,0x00,
+	0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x05,0x5F,0x00,0x00,0x00,0x00,0x0C,0x8B,
+	0xC8,0x20,0x00,0x00,0x0A,0x0E,0xF0,0x10,0x00,0x00,0x00,0x00,0x00,0x0C,0xDB,0xDC,
+	0x55,0xB9,0x19,0x3D,0x07,0x2D,0x0F,0x10,0x14,0x01,0x0B,0x00,0x00,0x00,0x01,0x04,
+	0x85,0x19,0x08,0x38,0x04,0x3D,0x01,0x06,0x09,0xB1,0xA7,0x54,0x1E,0x0F,0x02,0x2B,
+	0x05,0x0F,0x73,0x6B,0x29,0x1E,0x52,0x00,0x68,0xEE,0x5D,0x2F,0x08,0xC0,0x2A,0xE9,
+	0x25,0x35,0x0A,0x1F,0x01,0x21,0x1D,0x04,0x09,0x00,0x00,0x00,0x02,0x0F,0x93,0x1D,
+	0x08,0x38,0x02,0x1D,0x04,0x03,0x0C,0x00,0x29,0x26,0x20,0x40,0x35,0x27,0x1D,0x40,
+	0x04,0xAC,0x3B,0x2D,0x05,0x24,0x07,0x13,0x1B,0x1E,0x07,0x00,0x00,0x00,0x01,0x08,
+	0x50,0x20,0x08,0x38,0x06,0xBB,0x02,0x04,0x89,0x80,0x0A,0xF0,0x02,0x12,0x2D,0xD5,
+	0x00,0x80,0x2D,0x49,0x01,0x00,0x1D,0x75,0x3E,0x35,0x04,0x38,0x02,0x1F,0x0E,0x1E,
+	0x0F,0x00,0x00,0x00,0x15,0x05,0x14,0x02,0x08,0x38,0x02,0x3F,0x02,0x03,0x69,0xA4,
+	0x89,0x0D,0x68,0x8F,0x25,0x10,0x1D,0xD9,0x01,0x76,0x24,0x2D,0x09,0x2D,0x0B,0x25,
+	0x08,0x02,0x04,0x00,0x00,0x00,0x06,0x05,0x23,0x13,0x08,0x38,0x04,0xB1,0x04,0x02,
+	0x00,0x36,0x00,0xDE,0x05,0x00,0x89,0x88,0x27,0x25,0x0A,0x38,0x10,0x28,0x1C,0x1B,
+	0x0C,0x00,0x00,0x00,0x99,0x0C,0xE1,0x24,0x08,0x38,0x04,0x35,0x03,0x09,0x22,0x00,
+	0x34,0x82,0x20,0x00,0x14,0x8E,0x08,0x00,0xDD,0x40,0x1A,0x40,0x24,0x9D,0x62,0x63,
+	0x1C,0x2B,0x81,0x80,0x1C,0x11,0x2A,0x40,0x82,0x8E,0x3A,0x40,0x1A,0x1C,0x6D,0x0D,
+	0x1D,0x13,0x73,0x79,0x6E,0x74,0x68,0x65,0x74,0x69,0x63,0x20,0x74,0x65,0x73,0x74,
+	0x00,0x69,0x6E,0x73,0x00,0x69,0x6E,0x73,0x00,0x69,0x6E,0x73,0x00,0x69,0x6E,0x73,
+	0x00,0x69,0x6E,0x73,0x00,0x69,0x6E,0x73,0x00
+};
+
+static uint8_t renderBuffer[MAX_CHUNK * 4 * 4]; // 8bb: max. 4 channels of 32-bit
+
+// 8bb: audioCallback = false: ahxRender() until the song ends (sets numFrames), true: numFrames through paulaOutputSamples()
+static bool renderSong(const testMode_t *mode, int32_t simd, int32_t chunkSize, bool audioCallback, int32_t *numFrames, uint32_t *hash)
+{
+	ahxPlayer_t *player = ahxCreatePlayer();
+	if (player == NULL)
+		return false;
+
+	ahxSetOutputChannels(player, mode->channels);
+	ahxSetOutputFormat(player, mode->format);
+
+	if (!ahxInitRender(player, TEST_FREQ, 256, 20) || !ahxLoadFromRAM(player, testSong))
+	{
+		ahxDestroyPlayer(player);
+		return false;
+	}
+
+	paulaSetSIMD(&player->paula, simd);
+	paulaSetQuality(&player->paula, mode->quality);
+	paulaSetFixedPoint(&player->paula, mode->fixedPoint);
+
+	if (!ahxPlay(player, 0))
+	{
+		ahxCloseRender(player);
+		ahxDestroyPlayer(player);
+		return false;
+	}
+
+	const int32_t bytesPerFrame = paulaGetBytesPerFrame(&player->paula);
+
+	uint32_t h = 2166136261UL; // 8bb: FNV-1a
+	int32_t framesRendered, framesTotal = 0;
+	do
+	{
+		if (audioCallback)
+		{
+			framesRendered = *numFrames - framesTotal;
+			if (framesRendered > chunkSize)
+				framesRendered = chunkSize;
+
+			paulaOutputSamples(player, (int16_t *)renderBuffer, framesRendered);
+		}
+		else
+		{
+			framesRendered = ahxRender(player, renderBuffer, chunkSize, NULL);
+		}
+
+		for (int32_t i = 0; i < framesRendered * bytesPerFrame; i++)
+			h = (h ^ renderBuffer[i]) * 16777619UL;
+
+		framesTotal += framesRendered;
+	}
+	while (framesRendered == chunkSize && (!audioCallback || framesTotal < *numFrames));
+
+	ahxCloseRender(player);
+	ahxDestroyPlayer(player);
+
+	*numFrames = framesTotal;
+	*hash = h;
+	return true;
+}
+
+/* 8bb: Switching between the float and the fixed-point mixer in the middle of a song has to carry on
+** with the voices where they are. Renders the song with one mixer, switches to the other one after
+** switchFrame frames, and compares the next frames with a render that stays with the first mixer.
+** The two mixers round differently, so the difference is small, but not zero.
+*/
+#define SWITCH_TEST_FRAMES (TEST_FREQ * 2)
+#define SWITCH_COMPARE_FRAMES 256
+#define SWITCH_MAX_DIFF 1e-4f
+
+static float switchBuffer[2][SWITCH_TEST_FRAMES * 2];
+
+static bool renderSwitched(float *out, int32_t simd, bool fixedPointFirst, bool fixedPointAfter, int32_t switchFrame)
+{
+	ahxPlayer_t *player = ahxCreatePlayer();
+	if (player == NULL)
+		return false;
+
+	ahxSetOutputFormat(player, PAULA_FORMAT_F32);
+	if (!ahxInitRender(player, TEST_FREQ, 256, 20) || !ahxLoadFromRAM(player, testSong))
+	{
+		ahxDestroyPlayer(player);
+		return false;
+	}
+
+	paulaSetSIMD(&player->paula, simd);
+	paulaSetFixedPoint(&player->paula, fixedPointFirst);
+
+	bool ok = ahxPlay(player, 0);
+	if (ok)
+	{
+		ok = (ahxRender(player, out, switchFrame, NULL) == switchFrame);
+
+		paulaSetFixedPoint(&player->paula, fixedPointAfter);
+		ok &= (ahxRender(player, &out[switchFrame * 2], SWITCH_COMPARE_FRAMES, NULL) == SWITCH_COMPARE_FRAMES);
+	}
+
+	ahxCloseRender(player);
+	ahxDestroyPlayer(player);
+	return ok;
+}
+
+static bool testMixerSwitch(int32_t simd, bool toFixedPoint, int32_t switchFrame)
+{
+	if (!renderSwitched(switchBuffer[0], simd, !toFixedPoint, toFixedPoint, switchFrame) ||
+		!renderSwitched(switchBuffer[1], simd, !toFixedPoint, !toFixedPoint, switchFrame))
+		return false;
+
+	for (int32_t i = switchFrame * 2; i < (switchFrame + SWITCH_COMPARE_FRAMES) * 2; i++)
+	{
+		const float fDiff = switchBuffer[0][i] - switchBuffer[1][i];
+		if (fDiff > SWITCH_MAX_DIFF || fDiff < -SWITCH_MAX_DIFF)
+			return false;
+	}
+
+	return true;
+}
+
+/* 8bb: The audio device is opened with the player's channel count and is always 16-bit, so that can't
+** change while the player owns it. The voice mask is handed to the device's mixer through the command queue.
+** There's no audio device here, so ownership is faked on a render player.
+*/
+static bool testDeviceSettings(void)
+{
+	ahxPlayer_t *player = ahxCreatePlayer();
+	if (player == NULL)
+		return false;
+
+	if (!ahxInitRender(player, TEST_FREQ, 256, 20))
+	{
+		ahxDestroyPlayer(player);
+		return false;
+	}
+
+	player->ownsAudioDevice = true;
+
+	bool ok = true;
+	if (!ahxSetOutputChannels(player, 2)) // 8bb: no change
+		ok = false;
+
+	if (ahxSetOutputChannels(player, 1) || ahxGetErrorCode(player) != ERR_DEVICE_IN_USE || paulaGetOutputChannels(player) != 2)
+		ok = false;
+
+	if (!ahxSetOutputFormat(player, PAULA_FORMAT_S16)) // 8bb: no change
+		ok = false;
+
+	if (ahxSetOutputFormat(player, PAULA_FORMAT_F32) || ahxGetErrorCode(player) != ERR_DEVICE_IN_USE ||
+		paulaGetBytesPerFrame(&player->paula) != 2*sizeof (int16_t))
+		ok = false;
+
+	if (!ahxSetVoiceMask(player, 1) || player->paula.audio.disabledVoices != 0) // 8bb: only queued
+		ok = false;
+
+	processCommandQueue(player); // 8bb: what the mixer does before the next block
+	if (player->paula.audio.disabledVoices != 14)
+		ok = false;
+
+	player->ownsAudioDevice = false;
+
+	ahxCloseRender(player);
+	ahxDestroyPlayer(player);
+	return ok;
+}
+
+int main(void)
+{
+	const int32_t numModes = sizeof (testModes) / sizeof (testModes[0]);
+	const int32_t numChunkSizes = sizeof (chunkSizes) / sizeof (chunkSizes[0]);
+	const int32_t maxSIMD = paulaGetCPUSIMD();
+	int32_t failed = 0;
+
+	for (int32_t simd = PAULA_SIMD_NONE; simd <= maxSIMD; simd++)
+	{
+		for (int32_t i = 0; i < numModes; i++)
+		{
+			const testMode_t *mode = &testModes[i];
+			const bool checkHash = mode->fixedPoint || CHECK_FLOAT_HASHES;
+
+			// 8bb: the audio device is always 16-bit
+			const int32_t numPasses = (mode->format == PAULA_FORMAT_S16) ? 2 : 1;
+
+			uint32_t firstHash = 0;
+			int32_t numFrames = 0;
+			for (int32_t j = 0; j < numChunkSizes*numPasses; j++)
+			{
+				const bool audioCallback = (j >= numChunkSizes);
+				const int32_t chunkSize = chunkSizes[j % numChunkSizes];
+
+				uint32_t hash;
+				if (!renderSong(mode, simd, chunkSize, audioCallback, &numFrames, &hash))
+				{
+					printf("FAIL: %s (SIMD %d): couldn't render the test song\n", mode->name, simd);
+					failed++;
+					break;
+				}
+
+				if (j == 0)
+					firstHash = hash;
+
+				if (hash != firstHash || (checkHash && hash != mode->hash))
+				{
+					printf("FAIL: %s (SIMD %d, %s chunks of %d frames): hash %08X, expected %08X\n", mode->name, simd,
+						audioCallback ? "audio callback" : "ahxRender()", chunkSize, hash, checkHash ? mode->hash : firstHash);
+					failed++;
+				}
+			}
+		}
+	}
+
+	for (int32_t simd = PAULA_SIMD_NONE; simd <= maxSIMD; simd++)
+	{
+		for (int32_t i = 1; i <= 8; i++)
+		{
+			const int32_t switchFrame = i * 7919; // 8bb: somewhere in a note
+			for (int32_t j = 0; j < 2; j++)
+			{
+				if (!testMixerSwitch(simd, j == 0, switchFrame))
+				{
+					printf("FAIL: switching to the %s mixer at frame %d (SIMD %d) doesn't carry on\n",
+						(j == 0) ? "fixed-point" : "float", switchFrame, simd);
+					failed++;
+				}
+			}
+		}
+	}
+
+	if (!testDeviceSettings())
+	{
+		printf("FAIL: output settings aren't handled right on a player that owns the audio device\n");
+		failed++;
+	}
+
+	if (failed > 0)
+	{
+		printf("%d test(s) failed\n", failed);
+		return 1;
+	}
+
+	printf("All tests OK\n");
+	return 0;
+}
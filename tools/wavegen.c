@@ -0,0 +1,100 @@
+/*
+** 8bb:
+** Generates the AHX waveform tables (waves.c) as constant data, so that
+** they can be compiled into the binary (with AHX_CONST_WAVES defined)
+** instead of being generated every time a player is initialized.
+**
+** Usage: wavegen <output.c>
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "../replayer.h"
+
+static void writeArray(FILE *f, const char *name, const int8_t *src8, int32_t length)
+{
+	fprintf(f, "\t// %s\n\t{", name);
+	for (int32_t i = 0; i < length; i++)
+	{
+		if ((i & 15) == 0)
+			fprintf(f, "\n\t\t");
+
+		fprintf(f, "%d%s", src8[i], (i < length-1) ? "," : "");
+	}
+	fprintf(f, "\n\t},\n");
+}
+
+int main(int argc, char *argv[])
+{
+	if (argc != 2)
+	{
+		printf("Usage: wavegen <output.c>\n");
+		return 1;
+	}
+
+	// 8bb: make sure that the SIMD filter generator gives the exact same tables as the plain C one
+	if (!ahxTestWaveGenerator())
+	{
+		printf("Error: Waveform generator self-test failed!\n");
+		return 1;
+	}
+
+	waveforms_t *waves = (waveforms_t *)malloc(sizeof (waveforms_t));
+	if (waves == NULL)
+	{
+		printf("Error: Out of memory!\n");
+		return 1;
+	}
+
+	ahxGenerateWaves(waves);
+
+	FILE *f = fopen(argv[1], "w");
+	if (f == NULL)
+	{
+		printf("Error: Couldn't open \"%s\" for writing!\n", argv[1]);
+		free(waves);
+		return 1;
+	}
+
+	fprintf(f, "// 8bb: generated by tools/wavegen.c, don't edit!\n\n");
+	fprintf(f, "#include <stdint.h>\n");
+	fprintf(f, "#include \"replayer.h\"\n\n");
+	fprintf(f, "// 8bb: the replayer does 32-bit reads from these tables, so make sure they are dword-aligned\n");
+	fprintf(f, "#ifdef _MSC_VER\n__declspec(align(4))\n#endif\n");
+	fprintf(f, "const waveforms_t ahxConstWaves\n");
+	fprintf(f, "#ifdef __GNUC__\n__attribute__ ((aligned (4)))\n#endif\n");
+	fprintf(f, "=\n{\n");
+
+	writeArray(f, "lowPasses",     waves->lowPasses,     sizeof (waves->lowPasses));
+	writeArray(f, "triangle04",    waves->triangle04,    sizeof (waves->triangle04));
+	writeArray(f, "triangle08",    waves->triangle08,    sizeof (waves->triangle08));
+	writeArray(f, "triangle10",    waves->triangle10,    sizeof (waves->triangle10));
+	writeArray(f, "triangle20",    waves->triangle20,    sizeof (waves->triangle20));
+	writeArray(f, "triangle40",    waves->triangle40,    sizeof (waves->triangle40));
+	writeArray(f, "triangle80",    waves->triangle80,    sizeof (waves->triangle80));
+	writeArray(f, "sawtooth04",    waves->sawtooth04,    sizeof (waves->sawtooth04));
+	writeArray(f, "sawtooth08",    waves->sawtooth08,    sizeof (waves->sawtooth08));
+	writeArray(f, "sawtooth10",    waves->sawtooth10,    sizeof (waves->sawtooth10));
+	writeArray(f, "sawtooth20",    waves->sawtooth20,    sizeof (waves->sawtooth20));
+	writeArray(f, "sawtooth40",    waves->sawtooth40,    sizeof (waves->sawtooth40));
+	writeArray(f, "sawtooth80",    waves->sawtooth80,    sizeof (waves->sawtooth80));
+	writeArray(f, "squares",       waves->squares,       sizeof (waves->squares));
+	writeArray(f, "whiteNoiseBig", waves->whiteNoiseBig, sizeof (waves->whiteNoiseBig));
+	writeArray(f, "highPasses",    waves->highPasses,    sizeof (waves->highPasses));
+
+	fprintf(f, "};\n");
+
+	const bool writeError = (ferror(f) != 0);
+	fclose(f);
+	free(waves);
+
+	if (writeError)
+	{
+		printf("Error: Couldn't write to \"%s\"!\n", argv[1]);
+		return 1;
+	}
+
+	return 0;
+}
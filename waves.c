@@ -0,0 +1,469 @@
+/*
+** 8bb:
+** AHX 2.3d-sp3 waveform generators (bit-accurate).
+**
+** The tables only depend on constants, so they are normally generated at
+** build time by tools/wavegen.c (AHX_CONST_WAVES). Without that, they get
+** generated at runtime, the filtered ones only when a song needs them.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include "replayer.h"
+
+// 8bb: SSE2 is always there on x86-64, it's only used for the filter levels (see setUpFilterWaveForms8())
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WAVES_SSE2
+#endif
+
+// 8bb: filter coefficient for level 0..30. AHX adds the second constant once per level, so this is the same value
+#define FILTER_COEFF(level) ((((((8<<16)*125)/100)/100)>>8) + ((level) * (((((3<<16)*125)/100)/100)>>8)))
+
+// 8bb: added +1 to all values in this table (was meant for 68k DBRA loop)
+static const uint16_t lengthTable[6+6+32+1] =
+{
+	0x04,0x08,0x10,0x20,0x40,0x80,
+	0x04,0x08,0x10,0x20,0x40,0x80,
+
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+	0x80,0x80,0x80,0x80,0x80,0x80,0x80,0x80,
+
+	WHITENOISE_LENGTH
+};
+
+static void triangleGenerate(int8_t *dst8, int16_t delta, int32_t offset, int32_t length)
+{
+	int16_t data = 0;
+	for (int32_t i = 0; i < length+1; i++)
+	{
+		*dst8++ = (uint8_t)data;
+		data += delta;
+	}
+	*dst8++ = 127;
+
+	data = 128;
+	for (int32_t i = 0; i < length; i++)
+	{
+		data -= delta;
+		*dst8++ = (uint8_t)data;
+	}
+
+	int8_t *src8 = &dst8[offset];
+	for (int32_t i = 0; i < (length+1)*2; i++)
+	{
+		int8_t sample = *src8++;
+		if (sample == 127)
+			sample = -128;
+		else
+			sample = 0 - sample;
+
+		*dst8++ = sample;
+	}
+}
+
+static void sawToothGenerate(int8_t *dst8, int32_t length)
+{
+	const int8_t delta = (int8_t)(256 / (length-1));
+
+	int8_t data = -128;
+	for (int32_t i = 0; i < length; i++)
+	{
+		*dst8++ = data;
+		data += delta;
+	}
+}
+
+static void squareGenerate(int8_t *dst8)
+{
+	uint16_t *dst16 = (uint16_t *)dst8;
+	for (int32_t i = 1; i <= 32; i++)
+	{
+		for (int32_t j = 0; j < 64-i; j++)
+			*dst16++ = 0x8080;
+
+		for (int32_t j = 0; j < i; j++)
+			*dst16++ = 0x7F7F;
+	}
+}
+
+static void whiteNoiseGenerate(int8_t *dst8, int32_t length)
+{
+	uint32_t seed = 0x41595321; // 8bb: "AYS!"
+
+	for (int32_t i = 0; i < length; i++)
+	{
+		if (!(seed & 256))
+			*dst8++ = (uint8_t)seed;
+		else if (seed & 0x8000)
+			*dst8++ = -128;
+		else
+			*dst8++ = 127;
+
+		ROR32(seed, 5);
+		seed ^= 0b10011010;
+		uint16_t tmp16 = (uint16_t)seed;
+		ROL32(seed, 2);
+		tmp16 += (uint16_t)seed;
+		seed ^= tmp16;
+		ROR32(seed, 3);
+	}
+}
+
+static inline int32_t fp16Clip(int32_t x)
+{
+	int16_t fp16Int = x >> 16;
+
+	if (fp16Int > 127)
+	{
+		fp16Int = 127;
+		return fp16Int << 16;
+	}
+
+	if (fp16Int < -128)
+	{
+		fp16Int = -128;
+		return fp16Int << 16;
+	}
+
+	return x;
+}
+
+static void setUpFilterWaveForm(waveforms_t *waves, int32_t level) // 8bb: level = 0..30
+{
+	int8_t *dst8Hi = &waves->highPasses[level * WAV_FILTER_LENGTH];
+	int8_t *dst8Lo = &waves->lowPasses[level * WAV_FILTER_LENGTH];
+
+	const int32_t d5 = FILTER_COEFF(level);
+
+	int8_t *src8 =  waves->triangle04; // 8bb: beginning of waveforms
+	for (int32_t j = 0; j < 6+6+32+1; j++)
+	{
+		const int32_t waveLength = lengthTable[j];
+		
+		int32_t d1;
+		int32_t d2 = 0;
+		int32_t d3 = 0;
+
+		// 8bb: 1st pass
+		for (int32_t k = 0; k < waveLength; k++)
+		{
+			const int32_t d0 = (int16_t)src8[k] << 16;
+
+			d1 = fp16Clip(d0 - d2 - d3);
+			d2 = fp16Clip(d2 + ((d1 >> 8) * d5));
+			d3 = fp16Clip(d3 + ((d2 >> 8) * d5));
+		}
+
+		// 8bb: 2nd pass
+		for (int32_t k = 0; k < waveLength; k++)
+		{
+			const int32_t d0 = (int16_t)src8[k] << 16;
+
+			d1 = fp16Clip(d0 - d2 - d3);
+			d2 = fp16Clip(d2 + ((d1 >> 8) * d5));
+			d3 = fp16Clip(d3 + ((d2 >> 8) * d5));
+		}
+
+		// 8bb: 3rd pass
+		for (int32_t k = 0; k < waveLength; k++)
+		{
+			const int32_t d0 = (int16_t)src8[k] << 16;
+
+			d1 = fp16Clip(d0 - d2 - d3);
+			d2 = fp16Clip(d2 + ((d1 >> 8) * d5));
+			d3 = fp16Clip(d3 + ((d2 >> 8) * d5));
+		}
+		
+		/* 8bb:
+		** Truncate lower 8 bits so that it's bit-accurate
+		** to how AHX does it (it uses a bit-reduced LUT).
+		*/
+		d2 &= ~0xFF;
+		d3 &= ~0xFF;
+
+		// 8bb: 4th pass (also writes to output)
+		for (int32_t k = 0; k < waveLength; k++)
+		{
+			const int32_t d0 = (int16_t)src8[k] << 16;
+
+			d1 = fp16Clip(d0 - d2 - d3);
+			d2 = fp16Clip(d2 + ((d1 >> 8) * d5));
+			d3 = fp16Clip(d3 + ((d2 >> 8) * d5));
+
+			*dst8Hi++ = (uint8_t)(d1 >> 16);
+			*dst8Lo++ = (uint8_t)(d3 >> 16);
+		}
+
+		src8 += waveLength; // 8bb: go to next waveform
+	}
+}
+
+#ifdef WAVES_SSE2
+static inline __m128i fp16ClipSSE2(__m128i x) // 8bb: same as fp16Clip(), for four values
+{
+	const __m128i gt = _mm_cmpgt_epi32(x, _mm_set1_epi32((128<<16)-1));
+	const __m128i lt = _mm_cmplt_epi32(x, _mm_set1_epi32(-(128<<16)));
+
+	x = _mm_or_si128(_mm_andnot_si128(gt, x), _mm_and_si128(gt, _mm_set1_epi32(127<<16)));
+	x = _mm_or_si128(_mm_andnot_si128(lt, x), _mm_and_si128(lt, _mm_set1_epi32(-(128<<16))));
+
+	return x;
+}
+
+/* 8bb:
+** Same as setUpFilterWaveForm(), but for up to eight levels at once (one per SSE2 lane,
+** two vectors that are interleaved to hide the latency of the d1->d2->d3 chain).
+** The levels only differ in d5, so all lanes read the same source sample.
+**
+** (d1 >> 8) and (d2 >> 8) always fit in 16 bits (fp16Clip() keeps them within -128..127.99),
+** and d5 is 25..295, so _mm_madd_epi16() against d5 (with zeroed upper halves) gives
+** the exact 32-bit product.
+*/
+
+#define FILTER_STEP(d0, d1, d2, d3, vD5) \
+	d1 = fp16ClipSSE2(_mm_sub_epi32(_mm_sub_epi32(d0, d2), d3)); \
+	d2 = fp16ClipSSE2(_mm_add_epi32(d2, _mm_madd_epi16(_mm_srai_epi32(d1, 8), vD5))); \
+	d3 = fp16ClipSSE2(_mm_add_epi32(d3, _mm_madd_epi16(_mm_srai_epi32(d2, 8), vD5)));
+
+static void setUpFilterWaveForms8(waveforms_t *waves, const int32_t *levels, int32_t numLevels)
+{
+	int32_t d5[8];
+	int8_t *dst8Hi[8], *dst8Lo[8];
+
+	for (int32_t i = 0; i < 8; i++)
+	{
+		const int32_t level = levels[(i < numLevels) ? i : 0]; // 8bb: unused lanes do the first level again (not written)
+
+		d5[i] = FILTER_COEFF(level);
+		dst8Hi[i] = &waves->highPasses[level * WAV_FILTER_LENGTH];
+		dst8Lo[i] = &waves->lowPasses[level * WAV_FILTER_LENGTH];
+	}
+
+	const __m128i vD5A = _mm_loadu_si128((const __m128i *)&d5[0]);
+	const __m128i vD5B = _mm_loadu_si128((const __m128i *)&d5[4]);
+	const __m128i truncMask = _mm_set1_epi32(~0xFF);
+
+	int32_t offset = 0;
+	const int8_t *src8 = waves->triangle04; // 8bb: beginning of waveforms
+	for (int32_t j = 0; j < 6+6+32+1; j++)
+	{
+		const int32_t waveLength = lengthTable[j];
+
+		__m128i d1A, d2A = _mm_setzero_si128(), d3A = _mm_setzero_si128();
+		__m128i d1B, d2B = _mm_setzero_si128(), d3B = _mm_setzero_si128();
+
+		// 8bb: 1st, 2nd and 3rd pass
+		for (int32_t pass = 0; pass < 3; pass++)
+		{
+			for (int32_t k = 0; k < waveLength; k++)
+			{
+				const __m128i d0 = _mm_set1_epi32((int16_t)src8[k] << 16);
+
+				FILTER_STEP(d0, d1A, d2A, d3A, vD5A)
+				FILTER_STEP(d0, d1B, d2B, d3B, vD5B)
+			}
+		}
+
+		// 8bb: truncate lower 8 bits (see setUpFilterWaveForm())
+		d2A = _mm_and_si128(d2A, truncMask);
+		d3A = _mm_and_si128(d3A, truncMask);
+		d2B = _mm_and_si128(d2B, truncMask);
+		d3B = _mm_and_si128(d3B, truncMask);
+
+		// 8bb: 4th pass (also writes to output)
+		for (int32_t k = 0; k < waveLength; k++)
+		{
+			const __m128i d0 = _mm_set1_epi32((int16_t)src8[k] << 16);
+
+			FILTER_STEP(d0, d1A, d2A, d3A, vD5A)
+			FILTER_STEP(d0, d1B, d2B, d3B, vD5B)
+
+			int32_t hi[8], lo[8];
+			_mm_storeu_si128((__m128i *)&hi[0], _mm_srai_epi32(d1A, 16));
+			_mm_storeu_si128((__m128i *)&hi[4], _mm_srai_epi32(d1B, 16));
+			_mm_storeu_si128((__m128i *)&lo[0], _mm_srai_epi32(d3A, 16));
+			_mm_storeu_si128((__m128i *)&lo[4], _mm_srai_epi32(d3B, 16));
+
+			for (int32_t i = 0; i < numLevels; i++)
+			{
+				dst8Hi[i][offset+k] = (int8_t)hi[i];
+				dst8Lo[i][offset+k] = (int8_t)lo[i];
+			}
+		}
+
+		src8 += waveLength; // 8bb: go to next waveform
+		offset += waveLength;
+	}
+}
+#endif
+
+static void setUpFilterWaveForms(waveforms_t *waves, uint32_t levels) // 8bb: bit n = level n
+{
+#ifdef WAVES_SSE2
+	int32_t laneLevels[8], numLevels = 0;
+	for (int32_t i = 0; i < 31; i++)
+	{
+		if (!(levels & (1UL << i)))
+			continue;
+
+		laneLevels[numLevels++] = i;
+		if (numLevels == 8)
+		{
+			setUpFilterWaveForms8(waves, laneLevels, numLevels);
+			numLevels = 0;
+		}
+	}
+
+	if (numLevels > 0)
+		setUpFilterWaveForms8(waves, laneLevels, numLevels);
+#else
+	for (int32_t i = 0; i < 31; i++)
+	{
+		if (levels & (1UL << i))
+			setUpFilterWaveForm(waves, i);
+	}
+#endif
+}
+
+static void generateBaseWaves(waveforms_t *waves)
+{
+	int8_t *dst8 =  waves->triangle04;
+	for (int32_t i = 0; i < 6; i++)
+	{
+		uint16_t fullLength = 4 << i;
+		uint16_t length = fullLength >> 2;
+		uint16_t delta = 128 / length;
+		int32_t offset = 0 - (fullLength >> 1);
+
+		triangleGenerate(dst8, delta, offset, length-1);
+		dst8 += fullLength;
+	}
+
+	sawToothGenerate(waves->sawtooth04, 0x04);
+	sawToothGenerate(waves->sawtooth08, 0x08);
+	sawToothGenerate(waves->sawtooth10, 0x10);
+	sawToothGenerate(waves->sawtooth20, 0x20);
+	sawToothGenerate(waves->sawtooth40, 0x40);
+	sawToothGenerate(waves->sawtooth80, 0x80);
+	squareGenerate(waves->squares);
+	whiteNoiseGenerate(waves->whiteNoiseBig, WHITENOISE_LENGTH);
+}
+
+void ahxGenerateWaves(waveforms_t *waves)
+{
+	generateBaseWaves(waves);
+	setUpFilterWaveForms(waves, FILTER_LEVELS_ALL);
+}
+
+bool ahxTestWaveGenerator(void) // 8bb: returns false if the fast filter generator doesn't match the reference
+{
+	waveforms_t *wavesRef = (waveforms_t *)malloc(sizeof (waveforms_t));
+	waveforms_t *wavesTest = (waveforms_t *)malloc(sizeof (waveforms_t));
+
+	if (wavesRef == NULL || wavesTest == NULL)
+	{
+		free(wavesRef);
+		free(wavesTest);
+		return false;
+	}
+
+	memset(wavesRef, 0, sizeof (waveforms_t));
+	memset(wavesTest, 0, sizeof (waveforms_t));
+
+	generateBaseWaves(wavesRef);
+	generateBaseWaves(wavesTest);
+
+	for (int32_t i = 0; i < 31; i++)
+		setUpFilterWaveForm(wavesRef, i); // 8bb: reference (plain C, one level at a time)
+
+	// 8bb: all levels at once, then every odd-sized group (tests partially used SIMD lanes)
+	setUpFilterWaveForms(wavesTest, FILTER_LEVELS_ALL);
+	bool result = (memcmp(wavesRef, wavesTest, sizeof (waveforms_t)) == 0);
+
+	memset(wavesTest->lowPasses, 0, sizeof (wavesTest->lowPasses));
+	memset(wavesTest->highPasses, 0, sizeof (wavesTest->highPasses));
+	setUpFilterWaveForms(wavesTest, 0x55555555UL & FILTER_LEVELS_ALL);
+	setUpFilterWaveForms(wavesTest, 0x2AAAAAAAUL);
+	result &= (memcmp(wavesRef, wavesTest, sizeof (waveforms_t)) == 0);
+
+	free(wavesRef);
+	free(wavesTest);
+
+	return result;
+}
+
+#ifdef AHX_CONST_WAVES
+
+extern const waveforms_t ahxConstWaves; // 8bb: ahxwaves.c, generated at build time by tools/wavegen.c
+
+void ahxFreeWaves(ahxPlayer_t *player)
+{
+	player->waves = NULL; // 8bb: read-only table in the binary, nothing to free
+	player->filterLevelsDone = 0;
+}
+
+bool ahxInitWaves(ahxPlayer_t *player)
+{
+	player->waves = &ahxConstWaves;
+	player->filterLevelsDone = FILTER_LEVELS_ALL; // 8bb: everything is already there
+	return true;
+}
+
+void ahxGenerateFilterLevels(ahxPlayer_t *player, uint32_t levels)
+{
+	(void)player; // 8bb: all filter levels are in the table
+	(void)levels;
+}
+
+#else
+
+void ahxFreeWaves(ahxPlayer_t *player)
+{
+	if (player->waves != NULL)
+	{
+		free((waveforms_t *)player->waves);
+		player->waves = NULL;
+	}
+
+	player->filterLevelsDone = 0;
+}
+
+/* 8bb:
+** This only generates the unfiltered waveforms. The 31 low-pass/high-pass
+** levels are generated by ahxGenerateFilterLevels() when a song that can
+** reach them is set (ahxSetModule()), or when the replayer first needs one.
+** Levels that are never generated are never touched, so their memory pages
+** aren't even committed on most systems.
+*/
+bool ahxInitWaves(ahxPlayer_t *player)
+{
+	ahxFreeWaves(player);
+
+	// 8bb: "waves" needs dword-alignment, and that's guaranteed from malloc()
+	waveforms_t *waves = (waveforms_t *)malloc(sizeof (waveforms_t));
+	if (waves == NULL)
+		return false;
+
+	generateBaseWaves(waves);
+
+	player->waves = waves;
+	player->filterLevelsDone = 0;
+	return true;
+}
+
+void ahxGenerateFilterLevels(ahxPlayer_t *player, uint32_t levels) // 8bb: bit n = filter level n (see FILTER_LEVEL_BIT())
+{
+	levels &= FILTER_LEVELS_ALL & ~player->filterLevelsDone;
+	if (levels == 0 || player->waves == NULL)
+		return;
+
+	setUpFilterWaveForms((waveforms_t *)player->waves, levels); // 8bb: allocated by ahxInitWaves(), so this is safe
+	player->filterLevelsDone |= levels;
+}
+
+#endif